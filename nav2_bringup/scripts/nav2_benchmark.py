@@ -0,0 +1,312 @@
+#!/usr/bin/env python
+"""
+Multi-robot scaling benchmark for nav2_driver.
+
+For every robot count, starts that many mock Nav2 bases (mock_nav2_server) and either one nav2_driver per base, each
+in its own robotN namespace with robot_name set, or a single nav2_fleet_driver serving all of them. Every robot then
+gets synthetic cmd_vel load while the benchmark measures, over the same window:
+
+  - CPU (percent of one core) and resident memory of the driver processes, from /proc
+  - /tf message rate and bandwidth
+  - odometry rate and age (receive time minus header stamp) per robot
+
+and prints one row per robot count, optionally also written to a CSV file. Run it through nav2_benchmark.launch, which
+also starts a master if there is none.
+
+Private parameters:
+  ~robot_counts  Robot counts to measure, eg "1 2 4 8" (default "1 2 4 8 16")
+  ~mode          "drivers" for one nav2_driver per robot, "fleet" for one nav2_fleet_driver (default "drivers")
+  ~base_port     Port of the first mock base, the others follow (default 5100)
+  ~mock_args     Extra mock_nav2_server arguments, eg "--latency 0.005 --jitter 0.002" (default "")
+  ~driver_params Dictionary of parameters for every driver, eg {odom_rate: 20.0, io_thread: true} (default {})
+  ~cmd_rate      Synthetic cmd_vel rate per robot in Hz (default 10.0)
+  ~startup_timeout  Seconds to wait for every robot's first odometry message (default 15.0)
+  ~warmup        Seconds of load before measuring (default 2.0)
+  ~duration      Seconds to measure for (default 10.0)
+  ~output        CSV file for the results, empty to only print them (default "")
+"""
+
+import math
+import os
+import signal
+import subprocess
+import threading
+import time
+
+import rospy
+from geometry_msgs.msg import Twist
+from nav_msgs.msg import Odometry
+
+CLOCK_TICKS = float(os.sysconf('SC_CLK_TCK'))
+PAGE_SIZE = os.sysconf('SC_PAGE_SIZE')
+
+COLUMNS = ['robots', 'driver_cpu', 'driver_cpu_per_robot', 'driver_rss_mb', 'mock_cpu', 'tf_msgs', 'tf_kbytes',
+           'odom_rate', 'odom_age_mean', 'odom_age_p50', 'odom_age_p99', 'odom_age_max', 'missing']
+
+
+def read_stat(pid):
+    """Return (ppid, cpu seconds, resident bytes) of a process, or None if it is gone."""
+    try:
+        with open('/proc/%d/stat' % pid) as f:
+            # the command name may contain spaces, the fields after it do not
+            fields = f.read().rsplit(')', 1)[1].split()
+        with open('/proc/%d/statm' % pid) as f:
+            resident = int(f.read().split()[1])
+    except (IOError, OSError, IndexError, ValueError):
+        return None
+    return int(fields[1]), (int(fields[11]) + int(fields[12])) / CLOCK_TICKS, resident * PAGE_SIZE
+
+
+def process_tree(root):
+    """Return the pids of a process and all of its descendants, in case rosrun did not exec."""
+    children = {}
+    for entry in os.listdir('/proc'):
+        if entry.isdigit():
+            stat = read_stat(int(entry))
+            if stat is not None:
+                children.setdefault(stat[0], []).append(int(entry))
+    pids, pending = [], [root]
+    while pending:
+        pid = pending.pop()
+        pids.append(pid)
+        pending.extend(children.get(pid, []))
+    return pids
+
+
+def sample_usage(roots):
+    """Return (cpu seconds, resident bytes) summed over some processes and their descendants."""
+    cpu, rss = 0.0, 0
+    for root in roots:
+        for pid in process_tree(root):
+            stat = read_stat(pid)
+            if stat is not None:
+                cpu += stat[1]
+                rss += stat[2]
+    return cpu, rss
+
+
+def percentile(values, fraction):
+    if not values:
+        return float('nan')
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+class RobotProbe(object):
+    """Drives one robot with synthetic cmd_vel and records the age of its odometry."""
+
+    def __init__(self, name, index):
+        self.name = name
+        self.phase = index * 0.7
+        self.lock = threading.Lock()
+        self.ages = []
+        self.count = 0
+        self.cmd_pub = rospy.Publisher(name + '/cmd_vel', Twist, queue_size=1)
+        self.odom_sub = rospy.Subscriber(name + '/odom', Odometry, self.odometry, queue_size=100)
+
+    def odometry(self, msg):
+        age = (rospy.Time.now() - msg.header.stamp).to_sec()
+        with self.lock:
+            self.ages.append(age)
+            self.count += 1
+
+    def command(self, t):
+        # keep changing the command, so that the drivers never coalesce it away
+        cmd = Twist()
+        cmd.linear.x = 0.3 * math.sin(0.5 * t + self.phase)
+        cmd.angular.z = 0.5 * math.cos(0.3 * t + self.phase)
+        self.cmd_pub.publish(cmd)
+
+    def reset(self):
+        with self.lock:
+            self.ages = []
+            self.count = 0
+
+    def take(self):
+        with self.lock:
+            ages, count = self.ages, self.count
+            self.ages, self.count = [], 0
+        return ages, count
+
+    def close(self):
+        self.odom_sub.unregister()
+        self.cmd_pub.unregister()
+
+
+class TopicBandwidth(object):
+    """Counts the messages and serialized bytes on a topic, whatever its type."""
+
+    def __init__(self, topic):
+        self.lock = threading.Lock()
+        self.msgs = 0
+        self.bytes = 0
+        self.sub = rospy.Subscriber(topic, rospy.AnyMsg, self.received, queue_size=1000)
+
+    def received(self, msg):
+        with self.lock:
+            self.msgs += 1
+            self.bytes += len(msg._buff)
+
+    def take(self):
+        with self.lock:
+            msgs, size = self.msgs, self.bytes
+            self.msgs, self.bytes = 0, 0
+        return msgs, size
+
+    def close(self):
+        self.sub.unregister()
+
+
+def stop_processes(processes):
+    for process in processes:
+        if process.poll() is None:
+            process.send_signal(signal.SIGINT)
+    deadline = time.time() + 5.0
+    for process in processes:
+        while process.poll() is None and time.time() < deadline:
+            time.sleep(0.05)
+        if process.poll() is None:
+            process.kill()
+            process.wait()
+
+
+class Benchmark(object):
+
+    def __init__(self):
+        self.mode = rospy.get_param('~mode', 'drivers')
+        if self.mode not in ('drivers', 'fleet'):
+            raise ValueError('mode must be drivers or fleet, not %s' % self.mode)
+        self.base_port = rospy.get_param('~base_port', 5100)
+        self.mock_args = str(rospy.get_param('~mock_args', '')).split()
+        self.driver_params = rospy.get_param('~driver_params', {}) or {}
+        self.cmd_rate = rospy.get_param('~cmd_rate', 10.0)
+        self.startup_timeout = rospy.get_param('~startup_timeout', 15.0)
+        self.warmup = rospy.get_param('~warmup', 2.0)
+        self.duration = rospy.get_param('~duration', 10.0)
+        self.output = rospy.get_param('~output', '')
+        self.processes = []
+        rospy.on_shutdown(lambda: stop_processes(self.processes))
+
+    def start(self, count):
+        """Start the mock bases and drivers for count robots, return (names, mock processes, driver processes)."""
+        names = ['robot%d' % i for i in range(count)]
+        mocks, drivers = [], []
+        for i in range(count):
+            mocks.append(subprocess.Popen(['rosrun', 'nav2_driver', 'mock_nav2_server',
+                                           '--port', str(self.base_port + i)] + self.mock_args))
+        self.processes.extend(mocks)
+        # give the mocks a moment to listen, the drivers would only back off and retry
+        time.sleep(0.5)
+
+        if self.mode == 'fleet':
+            rospy.set_param('/nav2_fleet_driver', dict(self.driver_params, robots=[
+                {'name': name, 'address': '127.0.0.1', 'port': self.base_port + i} for i, name in enumerate(names)]))
+            drivers.append(subprocess.Popen(['rosrun', 'nav2_driver', 'nav2_fleet_driver',
+                                             '__name:=nav2_fleet_driver']))
+        else:
+            for i, name in enumerate(names):
+                rospy.set_param('/%s/nav2_driver' % name, dict(self.driver_params, robot_name=name,
+                                                              robot_address='127.0.0.1',
+                                                              robot_port=self.base_port + i))
+                drivers.append(subprocess.Popen(['rosrun', 'nav2_driver', 'nav2_driver',
+                                                 '__name:=nav2_driver', '__ns:=/' + name]))
+        self.processes.extend(drivers)
+        return names, mocks, drivers
+
+    def stop(self, names):
+        stop_processes(self.processes)
+        self.processes = []
+        for param in ['/nav2_fleet_driver'] + ['/' + name for name in names]:
+            if rospy.has_param(param):
+                rospy.delete_param(param)
+
+    def measure(self, count):
+        names, mocks, drivers = self.start(count)
+        probes = [RobotProbe(name, i) for i, name in enumerate(names)]
+        tf = TopicBandwidth('/tf')
+        timer = rospy.Timer(rospy.Duration(1.0 / self.cmd_rate),
+                            lambda event: [probe.command(event.current_real.to_sec()) for probe in probes])
+        try:
+            deadline = time.time() + self.startup_timeout
+            while not rospy.is_shutdown() and time.time() < deadline and any(p.count == 0 for p in probes):
+                time.sleep(0.1)
+            rospy.sleep(self.warmup)
+
+            for probe in probes:
+                probe.reset()
+            tf.take()
+            cpu_start = sample_usage(drivers)[0]
+            mock_start = sample_usage(mocks)[0]
+            started = time.time()
+            rospy.sleep(self.duration)
+            elapsed = time.time() - started
+            cpu_end, rss = sample_usage(drivers)
+            mock_end = sample_usage(mocks)[0]
+            tf_msgs, tf_bytes = tf.take()
+            results = [probe.take() for probe in probes]
+        finally:
+            timer.shutdown()
+            tf.close()
+            for probe in probes:
+                probe.close()
+            self.stop(names)
+
+        ages = [age for robot_ages, _ in results for age in robot_ages]
+        driver_cpu = 100.0 * (cpu_end - cpu_start) / elapsed
+        return {
+            'robots': count,
+            'driver_cpu': driver_cpu,
+            'driver_cpu_per_robot': driver_cpu / count,
+            'driver_rss_mb': rss / 1048576.0,
+            'mock_cpu': 100.0 * (mock_end - mock_start) / elapsed,
+            'tf_msgs': tf_msgs / elapsed,
+            'tf_kbytes': tf_bytes / 1024.0 / elapsed,
+            'odom_rate': sum(robot_count for _, robot_count in results) / elapsed / count,
+            'odom_age_mean': 1000.0 * sum(ages) / len(ages) if ages else float('nan'),
+            'odom_age_p50': 1000.0 * percentile(ages, 0.5),
+            'odom_age_p99': 1000.0 * percentile(ages, 0.99),
+            'odom_age_max': 1000.0 * max(ages) if ages else float('nan'),
+            'missing': sum(1 for _, robot_count in results if robot_count == 0),
+        }
+
+    def run(self, counts):
+        rows = []
+        for count in counts:
+            if rospy.is_shutdown():
+                break
+            rospy.loginfo('Measuring %d robot(s) with %s for %.1f s', count, self.mode, self.duration)
+            rows.append(self.measure(count))
+            if rows[-1]['missing']:
+                rospy.logwarn('%d of %d robot(s) published no odometry', rows[-1]['missing'], count)
+        report(rows, self.mode)
+        if self.output and rows:
+            with open(self.output, 'w') as f:
+                f.write(','.join(COLUMNS) + '\n')
+                for row in rows:
+                    f.write(','.join(str(row[column]) for column in COLUMNS) + '\n')
+            rospy.loginfo('Results written to %s', self.output)
+
+
+def report(rows, mode):
+    print('')
+    print('nav2_driver scaling, %s mode (CPU in percent of one core, odometry age in ms)' % mode)
+    print('%6s %9s %9s %8s %8s %8s %9s %8s %8s %8s %8s %8s' % (
+        'robots', 'cpu', 'cpu/robot', 'rss MB', 'mock cpu', 'tf msg/s', 'tf kB/s', 'odom Hz', 'age avg', 'age p50',
+        'age p99', 'age max'))
+    for row in rows:
+        print('%6d %9.1f %9.2f %8.1f %8.1f %8.0f %9.1f %8.1f %8.2f %8.2f %8.2f %8.2f' % tuple(
+            row[column] for column in COLUMNS[:-1]))
+    print('')
+
+
+def main():
+    rospy.init_node('nav2_benchmark')
+    counts = [int(count) for count in str(rospy.get_param('~robot_counts', '1 2 4 8 16')).replace(',', ' ').split()]
+    try:
+        Benchmark().run(counts)
+    except rospy.ROSInterruptException:
+        pass
+
+
+if __name__ == '__main__':
+    main()
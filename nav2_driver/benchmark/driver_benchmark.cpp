@@ -0,0 +1,103 @@
+/**
+ * End to end benchmark for Nav2Driver against the mock base: publishes cmd_vel at a fixed rate and measures the time
+ * until each command reaches the wire, plus the odometry rate seen by a subscriber. Needs a running roscore.
+ *
+ * Private parameters: rate (cmd_vel Hz), duration (s), latency, jitter, noise_rate (mock base link), and anything
+ * under ~driver is passed to the driver (eg ~driver/io_thread).
+ */
+
+#include "mock_nav2_server.h"
+
+#include <nav2_driver/nav2_driver.h>
+
+#include <ros/ros.h>
+#include <geometry_msgs/Twist.h>
+#include <nav_msgs/Odometry.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+namespace{
+
+using nav2_driver::MockNav2Server;
+
+unsigned long odom_count = 0;
+
+void countOdometry(const nav_msgs::OdometryConstPtr&){
+    ++odom_count;
+}
+
+}
+
+int main(int argc, char** argv){
+
+    ros::init(argc, argv, "nav2_driver_benchmark");
+    ros::NodeHandle nh, private_nh("~");
+
+    double rate, duration;
+    MockNav2Server::Options options;
+    private_nh.param<double>("rate", rate, 50.0);
+    private_nh.param<double>("duration", duration, 10.0);
+    private_nh.param<double>("latency", options.latency, 0.002);
+    private_nh.param<double>("jitter", options.jitter, 0.001);
+    private_nh.param<double>("noise_rate", options.noise_rate, 0.1);
+
+    MockNav2Server server(options);
+    server.start();
+
+    ros::NodeHandle driver_nh("~driver");
+    driver_nh.setParam("robot_address", std::string("127.0.0.1"));
+    driver_nh.setParam("robot_port", server.getPort());
+
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+    nav2_driver::Nav2Driver driver(nh, driver_nh);
+
+    ros::Publisher cmd_pub = nh.advertise<geometry_msgs::Twist>("cmd_vel", 5);
+    ros::Subscriber odom_sub = nh.subscribe("odom", 10, &countOdometry);
+    ros::Duration(1.0).sleep();
+    server.takeVelocityCommands();
+    odom_count = 0;
+
+    //each command carries its sequence number as speed, which the driver sends as the second v argument
+    std::map<long, double> sent;
+    ros::Rate loop(rate);
+    double start = MockNav2Server::now();
+    for(long seq = 1; ros::ok() && MockNav2Server::now() - start < duration; ++seq){
+        geometry_msgs::Twist twist;
+        twist.linear.x = seq * 1e-3;
+        sent[seq] = MockNav2Server::now();
+        cmd_pub.publish(twist);
+        loop.sleep();
+    }
+    ros::Duration(0.5).sleep();
+    double elapsed = MockNav2Server::now() - start;
+
+    std::vector<double> latencies;
+    std::vector<MockNav2Server::CommandRecord> records = server.takeVelocityCommands();
+    for(size_t i = 0; i < records.size(); ++i){
+        double vn, vs, turn;
+        if(sscanf(records[i].line.c_str(), "v %lf %lf %lf", &vn, &vs, &turn) == 3){
+            std::map<long, double>::iterator it = sent.find(lround(vs * 1e3));
+            if(it != sent.end()){
+                latencies.push_back(records[i].time - it->second);
+            }
+        }
+    }
+
+    printf("cmd_vel: %lu published, %lu reached the wire\n", (unsigned long)sent.size(), (unsigned long)latencies.size());
+    if(!latencies.empty()){
+        std::sort(latencies.begin(), latencies.end());
+        size_t n = latencies.size();
+        printf("cmd_vel to wire: p50 %.1f us  p90 %.1f us  p99 %.1f us  max %.1f us\n", latencies[n / 2] * 1e6,
+               latencies[n * 9 / 10] * 1e6, latencies[std::min(n - 1, n * 99 / 100)] * 1e6, latencies[n - 1] * 1e6);
+    }
+    printf("odom: %.1f Hz\n", odom_count / elapsed);
+
+    spinner.stop();
+    server.stop();
+    return 0;
+}
@@ -0,0 +1,344 @@
+#include "mock_nav2_server.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace nav2_driver{
+
+MockNav2Server::MockNav2Server(const Options& options) :
+    options_(options),
+    listen_fd_(-1),
+    port_(0),
+    udp_fd_(-1),
+    udp_port_(-1),
+    running_(false),
+    command_count_(0),
+    connection_count_(0),
+    datagram_count_(0),
+    stale_datagrams_(0),
+    x_(0), y_(0), th_(0), vx_(0), vy_(0), vth_(0),
+    max_speed_(0.5), max_accel_(0.5), max_cornering_error_(0.1),
+    queue_(0),
+    last_sim_(now()),
+    next_segment_(0),
+    seed_(42)
+{
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if(listen_fd_ < 0){
+        throw std::runtime_error("Mock Nav2 server can't create socket");
+    }
+
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(options_.port);
+    if(bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 16) < 0){
+        close(listen_fd_);
+        throw std::runtime_error("Mock Nav2 server can't listen on requested port");
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, (struct sockaddr*)&addr, &len);
+    port_ = ntohs(addr.sin_port);
+
+    if(options_.udp_port >= 0){
+        udp_fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        addr.sin_port = htons(options_.udp_port);
+        if(udp_fd_ < 0 || bind(udp_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+            if(udp_fd_ >= 0){
+                close(udp_fd_);
+            }
+            close(listen_fd_);
+            throw std::runtime_error("Mock Nav2 server can't bind requested UDP port");
+        }
+        len = sizeof(addr);
+        getsockname(udp_fd_, (struct sockaddr*)&addr, &len);
+        udp_port_ = ntohs(addr.sin_port);
+    }
+
+}
+
+MockNav2Server::~MockNav2Server(){
+    stop();
+    close(listen_fd_);
+    if(udp_fd_ >= 0){
+        close(udp_fd_);
+    }
+}
+
+void MockNav2Server::start(){
+    if(!running_.exchange(true)){
+        thread_ = boost::thread(&MockNav2Server::run, this);
+    }
+}
+
+void MockNav2Server::stop(){
+    if(running_.exchange(false)){
+        thread_.join();
+    }
+    for(size_t i = 0; i < clients_.size(); ++i){
+        close(clients_[i].fd);
+    }
+    clients_.clear();
+}
+
+std::vector<MockNav2Server::CommandRecord> MockNav2Server::takeVelocityCommands(){
+    boost::mutex::scoped_lock lock(records_mutex_);
+    std::vector<CommandRecord> records;
+    records.swap(velocity_records_);
+    return records;
+}
+
+double MockNav2Server::now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double MockNav2Server::random(){
+    return rand_r(&seed_) / (RAND_MAX + 1.0);
+}
+
+void MockNav2Server::run(){
+
+    std::vector<struct pollfd> fds;
+    char buffer[4096];
+
+    while(running_){
+
+        //wake for new connections, commands, or the next delayed reply
+        double t = now();
+        double wait = 0.01;
+        for(size_t i = 0; i < clients_.size(); ++i){
+            if(!clients_[i].replies.empty()){
+                wait = std::min(wait, std::max(0.0, clients_[i].replies.front().due - t));
+            }
+        }
+
+        fds.resize(clients_.size() + 2);
+        fds[0].fd = listen_fd_;
+        fds[0].events = POLLIN;
+        for(size_t i = 0; i < clients_.size(); ++i){
+            fds[i + 1].fd = clients_[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        fds.back().fd = udp_fd_;
+        fds.back().events = POLLIN;
+        fds.back().revents = 0;
+        poll(&fds[0], fds.size(), (int)ceil(wait * 1000.0));
+
+        t = now();
+        simulate(t);
+
+        if(fds.back().revents & POLLIN){
+            receiveDatagrams(t);
+        }
+
+        if(fds[0].revents & POLLIN){
+            int fd = accept(listen_fd_, NULL, NULL);
+            if(fd >= 0){
+                //replies are short lines, send them right away like the real base
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                Client client;
+                client.fd = fd;
+                clients_.push_back(client);
+                ++connection_count_;
+            }
+        }
+
+        for(size_t i = clients_.size(); i-- > 0;){
+            Client& client = clients_[i];
+            bool alive = true;
+
+            if(i + 2 < fds.size() && (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))){
+                ssize_t n = recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if(n <= 0){
+                    alive = false;
+                }else{
+                    client.input.append(buffer, n);
+                    size_t end;
+                    while(alive && (end = client.input.find('\n')) != std::string::npos){
+                        std::string line = client.input.substr(0, end);
+                        client.input.erase(0, end + 1);
+                        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+                        alive = handleCommand(client, line, t);
+                    }
+                }
+            }
+
+            //send replies that are due, in order
+            while(alive && !client.replies.empty() && client.replies.front().due <= t){
+                const std::string& text = client.replies.front().text;
+                if(send(client.fd, text.data(), text.size(), MSG_NOSIGNAL) != (ssize_t)text.size()){
+                    alive = false;
+                }
+                client.replies.pop_front();
+            }
+
+            if(!alive){
+                close(client.fd);
+                clients_.erase(clients_.begin() + i);
+            }
+        }
+    }
+
+}
+
+void MockNav2Server::receiveDatagrams(double now){
+
+    char buffer[512];
+    struct sockaddr_in from;
+    for(;;){
+        socklen_t len = sizeof(from);
+        ssize_t n = recvfrom(udp_fd_, buffer, sizeof(buffer) - 1, MSG_DONTWAIT, (struct sockaddr*)&from, &len);
+        if(n < 0){
+            return;
+        }
+        ++datagram_count_;
+        if(options_.datagram_loss > 0.0 && random() < options_.datagram_loss){
+            continue;
+        }
+
+        //"<sequence> <command>\n", only velocity commands
+        buffer[n] = 0;
+        char* command;
+        unsigned long sequence = strtoul(buffer, &command, 10);
+        if(command == buffer || *command != ' '){
+            continue;
+        }
+        std::string line(command + 1);
+        line.erase(std::remove(line.begin(), line.end(), '\n'), line.end());
+        if(line.compare(0, 2, "v ") != 0 && line.compare(0, 3, "av ") != 0){
+            continue;
+        }
+
+        //each sender numbers its own datagrams, keep only those newer than the newest seen
+        std::string sender((const char*)&from, len);
+        std::map<std::string, unsigned int>::iterator it = datagram_sequences_.find(sender);
+        if(it != datagram_sequences_.end() && (int)((unsigned int)sequence - it->second) <= 0){
+            ++stale_datagrams_;
+            continue;
+        }
+        datagram_sequences_[sender] = sequence;
+
+        //there is no stream to reply on, and velocity commands have no reply anyway
+        Client none;
+        none.fd = -1;
+        handleCommand(none, line, now);
+    }
+
+}
+
+bool MockNav2Server::handleCommand(Client& client, const std::string& line, double now){
+
+    ++command_count_;
+    if(options_.drop_rate > 0.0 && random() < options_.drop_rate){
+        return false;
+    }
+
+    char op[8] = "";
+    double a = 0, b = 0, c = 0;
+    sscanf(line.c_str(), "%7s %lf %lf %lf", op, &a, &b, &c);
+    std::string cmd(op);
+    char reply[128];
+
+    if(cmd == "q"){
+        snprintf(reply, sizeof(reply), "%lf %lf %lf %d\n", x_, y_, th_ * (180.0 / M_PI), queue_);
+        queueReply(client, reply, now);
+    }else if(cmd == "qms" || cmd == "qma" || cmd == "qmce"){
+        double value = cmd == "qms" ? max_speed_ : cmd == "qma" ? max_accel_ : max_cornering_error_;
+        snprintf(reply, sizeof(reply), "%lf\n", value);
+        queueReply(client, reply, now);
+    }else if(cmd == "v"){
+        vx_ = a;
+        vy_ = b;
+        vth_ = c * (M_PI / 180.0);
+        queue_ = 0;
+    }else if(cmd == "av"){
+        //absolute velocity, held in the robot frame at the current heading
+        vx_ = a * cos(th_) + b * sin(th_);
+        vy_ = -a * sin(th_) + b * cos(th_);
+        vth_ = 0;
+        queue_ = 0;
+    }else if(cmd == "s"){
+        vx_ = vy_ = vth_ = 0;
+        queue_ = 0;
+    }else if(cmd == "p"){
+        x_ = a;
+        y_ = b;
+        th_ = c * (M_PI / 180.0);
+    }else if(cmd == "mv" || cmd == "lt"){
+        if(queue_++ == 0){
+            next_segment_ = now + options_.segment_time;
+        }
+    }else if(cmd == "sms"){
+        max_speed_ = a;
+    }else if(cmd == "sma"){
+        max_accel_ = a;
+    }else if(cmd == "smce"){
+        max_cornering_error_ = a;
+    }
+
+    if(cmd == "v" || cmd == "av"){
+        CommandRecord record;
+        record.time = now;
+        record.line = line;
+        boost::mutex::scoped_lock lock(records_mutex_);
+        velocity_records_.push_back(record);
+    }
+
+    return true;
+
+}
+
+void MockNav2Server::queueReply(Client& client, const std::string& text, double now){
+
+    //later replies never overtake earlier ones on a stream
+    Reply reply;
+    reply.due = now + options_.latency + options_.jitter * random();
+    if(!client.replies.empty()){
+        reply.due = std::max(reply.due, client.replies.back().due);
+    }
+
+    if(options_.noise_rate > 0.0 && random() < options_.noise_rate){
+        reply.text = random() < 0.5 ? "| mock status line\r\n" : "+ mock debug line\r\n";
+    }
+    reply.text += text;
+    client.replies.push_back(reply);
+
+}
+
+void MockNav2Server::simulate(double now){
+
+    double dt = now - last_sim_;
+    last_sim_ = now;
+
+    x_ += (vx_ * cos(th_) - vy_ * sin(th_)) * dt;
+    y_ += (vx_ * sin(th_) + vy_ * cos(th_)) * dt;
+    th_ = atan2(sin(th_ + vth_ * dt), cos(th_ + vth_ * dt));
+
+    while(queue_ > 0 && now >= next_segment_){
+        --queue_;
+        next_segment_ += options_.segment_time;
+    }
+
+}
+
+}
@@ -0,0 +1,154 @@
+#ifndef NAV2_DRIVER_MOCK_NAV2_SERVER_H
+#define NAV2_DRIVER_MOCK_NAV2_SERVER_H
+
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace nav2_driver{
+
+/**
+ * @brief Minimal TCP server speaking the Nav2 turtle protocol, for benchmarks and soak tests without a real base.
+ *
+ * Integrates velocity commands into a simulated pose, counts queued motions down over time, and answers the q, qms,
+ * qma and qmce queries. Replies can be delayed by a configurable latency with jitter (keeping their order, as TCP
+ * would), interleaved with the |/+ noise lines the real firmware emits, and connections can be dropped at random to
+ * exercise reconnects. Velocity commands are optionally also accepted as sequence numbered UDP datagrams, where stale
+ * ones are dropped.
+ */
+class MockNav2Server{
+
+public:
+
+    struct Options{
+        Options() : port(0), latency(0.0), jitter(0.0), drop_rate(0.0), noise_rate(0.0), segment_time(0.5),
+            udp_port(-1), datagram_loss(0.0) {}
+
+        int port;               ///< TCP port, 0 to pick a free one
+        double latency;         ///< Reply delay in seconds
+        double jitter;          ///< Uniform random extra reply delay in seconds
+        double drop_rate;       ///< Probability of dropping the connection on each received command
+        double noise_rate;      ///< Probability of a noise line before each reply
+        double segment_time;    ///< Seconds to execute each queued motion command
+        int udp_port;           ///< UDP port for velocity datagrams, 0 to pick a free one, -1 to disable
+        double datagram_loss;   ///< Probability of losing each velocity datagram
+    };
+
+    /**
+     * @brief Record of a command line received from a client
+     */
+    struct CommandRecord{
+        double time;            ///< CLOCK_MONOTONIC arrival time in seconds
+        std::string line;       ///< Command line without terminator
+    };
+
+    /**
+     * @brief Bind the listening socket. Throws std::runtime_error on failure.
+     */
+    explicit MockNav2Server(const Options& options);
+
+    ~MockNav2Server();
+
+    /**
+     * @brief Start serving on a background thread
+     */
+    void start();
+
+    /**
+     * @brief Stop serving and close all connections
+     */
+    void stop();
+
+    /**
+     * @brief Get the port the server listens on
+     */
+    int getPort() const { return port_; }
+
+    /**
+     * @brief Get the port velocity datagrams are accepted on, or -1 if disabled
+     */
+    int getUdpPort() const { return udp_port_; }
+
+    /**
+     * @brief Take all velocity (v and av) commands received since the last call
+     */
+    std::vector<CommandRecord> takeVelocityCommands();
+
+    /**
+     * @brief Get the total number of commands received
+     */
+    unsigned long getCommandCount() const { return command_count_; }
+
+    /**
+     * @brief Get the number of connections accepted so far
+     */
+    unsigned long getConnectionCount() const { return connection_count_; }
+
+    /**
+     * @brief Get the number of velocity datagrams received, including lost and stale ones
+     */
+    unsigned long getDatagramCount() const { return datagram_count_; }
+
+    /**
+     * @brief Get the number of velocity datagrams dropped for arriving after a newer one
+     */
+    unsigned long getStaleDatagrams() const { return stale_datagrams_; }
+
+    /**
+     * @brief Current CLOCK_MONOTONIC time in seconds, the clock used for all records
+     */
+    static double now();
+
+private:
+
+    struct Reply{
+        double due;
+        std::string text;
+    };
+
+    struct Client{
+        int fd;
+        std::string input;
+        std::deque<Reply> replies;
+    };
+
+    // No copying allowed
+    MockNav2Server(const MockNav2Server&);
+    MockNav2Server& operator=(const MockNav2Server&);
+
+    void run();
+    void receiveDatagrams(double now);
+    bool handleCommand(Client& client, const std::string& line, double now);
+    void queueReply(Client& client, const std::string& text, double now);
+    void simulate(double now);
+    double random();
+
+    Options options_;
+    int listen_fd_, port_;
+    int udp_fd_, udp_port_;
+
+    boost::thread thread_;
+    boost::atomic<bool> running_;
+    boost::atomic<unsigned long> command_count_, connection_count_, datagram_count_, stale_datagrams_;
+
+    boost::mutex records_mutex_;
+    std::vector<CommandRecord> velocity_records_;
+
+    //simulated base state, only touched by the server thread
+    std::vector<Client> clients_;
+    std::map<std::string, unsigned int> datagram_sequences_;
+    double x_, y_, th_, vx_, vy_, vth_;
+    double max_speed_, max_accel_, max_cornering_error_;
+    int queue_;
+    double last_sim_, next_segment_;
+    unsigned int seed_;
+
+};
+
+}
+
+#endif
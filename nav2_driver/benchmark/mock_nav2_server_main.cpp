@@ -0,0 +1,76 @@
+/**
+ * Standalone mock Nav2 base, for running the driver without hardware.
+ *
+ * Usage: mock_nav2_server [--port N] [--latency S] [--jitter S] [--drop-rate P] [--noise-rate P]
+ *                         [--udp-port N] [--datagram-loss P]
+ */
+
+#include "mock_nav2_server.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+namespace{
+
+volatile sig_atomic_t running = 1;
+
+void handleSignal(int){
+    running = 0;
+}
+
+}
+
+int main(int argc, char** argv){
+
+    nav2_driver::MockNav2Server::Options options;
+    options.port = 5010;
+
+    for(int i = 1; i < argc; ++i){
+        //roslaunch appends remapping arguments such as __name:=mock and __log:=..., which are not ours
+        if(strstr(argv[i], ":=") || !strncmp(argv[i], "__", 2)){
+            continue;
+        }
+        if(i + 1 >= argc){
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char* option = argv[i];
+        const char* value = argv[++i];
+        if(!strcmp(option, "--port")) options.port = atoi(value);
+        else if(!strcmp(option, "--latency")) options.latency = atof(value);
+        else if(!strcmp(option, "--jitter")) options.jitter = atof(value);
+        else if(!strcmp(option, "--drop-rate")) options.drop_rate = atof(value);
+        else if(!strcmp(option, "--noise-rate")) options.noise_rate = atof(value);
+        else if(!strcmp(option, "--udp-port")) options.udp_port = atoi(value);
+        else if(!strcmp(option, "--datagram-loss")) options.datagram_loss = atof(value);
+        else{
+            fprintf(stderr, "Unknown option %s\n", option);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+
+    try{
+        nav2_driver::MockNav2Server server(options);
+        server.start();
+        printf("Mock Nav2 base listening on port %d\n", server.getPort());
+        if(server.getUdpPort() >= 0){
+            printf("Accepting velocity datagrams on UDP port %d\n", server.getUdpPort());
+        }
+        fflush(stdout);
+        while(running){
+            usleep(100000);
+        }
+        server.stop();
+    }catch(std::exception& e){
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
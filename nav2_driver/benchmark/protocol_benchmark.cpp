@@ -0,0 +1,143 @@
+/**
+ * Microbenchmark for the Nav2 protocol number encoding, comparing nav2protocol against the sprintf/sscanf path it
+ * replaces. Also checks that both produce identical results on the benchmark inputs.
+ *
+ * Usage: protocol_benchmark [iterations]
+ */
+
+#include <nav2_driver/nav2protocol.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <time.h>
+
+namespace{
+
+double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//mix of typical velocities, positions and headings in degrees, plus some awkward values
+std::vector<double> makeValues(int count){
+    std::vector<double> values;
+    srand(42);
+    for(int i = 0; i < count; ++i){
+        double r = rand() / (double)RAND_MAX;
+        switch(i % 4){
+            case 0: values.push_back((r - 0.5) * 2.0); break;
+            case 1: values.push_back((r - 0.5) * 200.0); break;
+            case 2: values.push_back((r - 0.5) * 720.0); break;
+            default: values.push_back(((r - 0.5) * 2e7) / (1 + rand() % 1000)); break;
+        }
+    }
+    values.push_back(0.0);
+    values.push_back(-0.0);
+    values.push_back(0.0000005);
+    values.push_back(-1e-9);
+    values.push_back(123456789.123);
+    return values;
+}
+
+}
+
+int main(int argc, char** argv){
+
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    std::vector<double> values = makeValues(10000);
+    std::vector<char> text(values.size() * 32);
+    char a[64], b[64];
+
+    //check results match before timing anything
+    int format_mismatches = 0, parse_mismatches = 0;
+    for(size_t i = 0; i < values.size(); ++i){
+        sprintf(a, "%lf", values[i]);
+        nav2protocol::formatDouble(b, values[i]);
+        if(strcmp(a, b) != 0){
+            if(format_mismatches++ < 5) printf("format mismatch: %s vs %s\n", a, b);
+        }
+        double x = 0, y = 0;
+        sscanf(a, "%lf", &x);
+        nav2protocol::parseDouble(a, y);
+        if(memcmp(&x, &y, sizeof(x)) != 0){
+            if(parse_mismatches++ < 5) printf("parse mismatch: %s -> %.17g vs %.17g\n", a, x, y);
+        }
+        strcpy(&text[i * 32], a);
+    }
+    printf("%d format mismatches, %d parse mismatches in %d values\n",
+           format_mismatches, parse_mismatches, (int)values.size());
+
+    //values the base cannot represent are rejected rather than truncated
+    const double rejected[] = { 1e16, -1e300, HUGE_VAL, -HUGE_VAL, NAN };
+    for(size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); ++i){
+        if(nav2protocol::formatDouble(b, rejected[i]) != -1){
+            if(format_mismatches++ < 5) printf("format accepted %lf\n", rejected[i]);
+        }
+    }
+
+    volatile int sink = 0;
+    double start = now();
+    for(int i = 0; i < iterations; ++i){
+        sink += sprintf(a, "%lf", values[i % values.size()]);
+    }
+    double sprintf_ns = (now() - start) * 1e9 / iterations;
+
+    start = now();
+    for(int i = 0; i < iterations; ++i){
+        sink += nav2protocol::formatDouble(b, values[i % values.size()]);
+    }
+    double format_ns = (now() - start) * 1e9 / iterations;
+
+    volatile double dsink = 0;
+    start = now();
+    for(int i = 0; i < iterations; ++i){
+        double x;
+        sscanf(&text[(i % values.size()) * 32], "%lf", &x);
+        dsink += x;
+    }
+    double sscanf_ns = (now() - start) * 1e9 / iterations;
+
+    start = now();
+    for(int i = 0; i < iterations; ++i){
+        double x;
+        nav2protocol::parseDouble(&text[(i % values.size()) * 32], x);
+        dsink += x;
+    }
+    double parse_ns = (now() - start) * 1e9 / iterations;
+
+    //a whole velocity command, as nav2remote used to build it and as the command table encodes it
+    char command[nav2protocol::SetRelativeVelocity::BUFFER_SIZE];
+    int command_mismatches = 0;
+    start = now();
+    for(int i = 0; i < iterations; ++i){
+        const double* v = &values[i % (values.size() - 2)];
+        sink += sprintf(a, "v %lf %lf %lf\n", v[0], v[1], v[2] * (180.0 / M_PI));
+    }
+    double command_sprintf_ns = (now() - start) * 1e9 / iterations;
+
+    start = now();
+    for(int i = 0; i < iterations; ++i){
+        sink += nav2protocol::encode<nav2protocol::SetRelativeVelocity>(command, &values[i % (values.size() - 2)]);
+    }
+    double encode_ns = (now() - start) * 1e9 / iterations;
+
+    for(size_t i = 0; i + 2 < values.size(); ++i){
+        const double* v = &values[i];
+        int len = sprintf(a, "v %lf %lf %lf\n", v[0], v[1], v[2] * (180.0 / M_PI));
+        if(std::fabs(v[0]) < 1e16 && std::fabs(v[1]) < 1e16 && std::fabs(v[2] * (180.0 / M_PI)) < 1e16 &&
+           (nav2protocol::encode<nav2protocol::SetRelativeVelocity>(command, v) != len || memcmp(a, command, len))){
+            ++command_mismatches;
+        }
+    }
+
+    printf("format: sprintf %.1f ns, formatDouble %.1f ns (%.1fx)\n", sprintf_ns, format_ns, sprintf_ns / format_ns);
+    printf("command: sprintf %.1f ns, encode %.1f ns (%.1fx), %d mismatches\n", command_sprintf_ns, encode_ns,
+           command_sprintf_ns / encode_ns, command_mismatches);
+    printf("parse:  sscanf %.1f ns, parseDouble %.1f ns (%.1fx)\n", sscanf_ns, parse_ns, sscanf_ns / parse_ns);
+
+    return format_mismatches || parse_mismatches || command_mismatches ? 1 : 0;
+}
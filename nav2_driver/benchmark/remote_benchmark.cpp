@@ -0,0 +1,120 @@
+/**
+ * Round trip benchmark for Nav2Remote against the mock base: blocking position queries, then pipelined asynchronous
+ * ones, then control cycles of a velocity command plus a position query sent separately and batched, reporting
+ * throughput and latency percentiles.
+ *
+ * Usage: remote_benchmark [iterations] [latency] [jitter] [noise_rate] [window]
+ */
+
+#include "mock_nav2_server.h"
+
+#include <nav2_driver/nav2remote.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+#include <poll.h>
+
+namespace{
+
+using nav2_driver::MockNav2Server;
+
+void report(const char* name, std::vector<double>& samples, double elapsed){
+    if(samples.empty()){
+        printf("%-10s no samples\n", name);
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    printf("%-10s %8.0f req/s  p50 %7.1f us  p90 %7.1f us  p99 %7.1f us  max %7.1f us\n", name, n / elapsed,
+           samples[n / 2] * 1e6, samples[n * 9 / 10] * 1e6, samples[std::min(n - 1, n * 99 / 100)] * 1e6,
+           samples[n - 1] * 1e6);
+}
+
+std::deque<double> sent;
+std::vector<double> latencies;
+
+void handlePosition(int rc){
+    if(rc == 0){
+        latencies.push_back(MockNav2Server::now() - sent.front());
+    }
+    sent.pop_front();
+}
+
+}
+
+int main(int argc, char** argv){
+
+    int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+    MockNav2Server::Options options;
+    options.latency = argc > 2 ? atof(argv[2]) : 0.0;
+    options.jitter = argc > 3 ? atof(argv[3]) : 0.0;
+    options.noise_rate = argc > 4 ? atof(argv[4]) : 0.1;
+    size_t window = argc > 5 ? atoi(argv[5]) : 8;
+
+    MockNav2Server server(options);
+    server.start();
+    Nav2Remote remote("127.0.0.1", server.getPort());
+
+    //blocking queries, one round trip each
+    double x, y, th;
+    double start = MockNav2Server::now();
+    for(int i = 0; i < iterations; ++i){
+        double t = MockNav2Server::now();
+        if(remote.estimatePosition(x, y, th) < 0){
+            fprintf(stderr, "IO error\n");
+            return 1;
+        }
+        latencies.push_back(MockNav2Server::now() - t);
+    }
+    report("blocking", latencies, MockNav2Server::now() - start);
+
+    //pipelined queries, up to window in flight
+    latencies.clear();
+    start = MockNav2Server::now();
+    int issued = 0;
+    while(issued < iterations || remote.getPendingReplies() > 0){
+        while(issued < iterations && (size_t)remote.getPendingReplies() < window){
+            sent.push_back(MockNav2Server::now());
+            if(remote.estimatePositionAsync(boost::bind(&handlePosition, _1)) < 0){
+                fprintf(stderr, "IO error\n");
+                return 1;
+            }
+            ++issued;
+        }
+        struct pollfd fd = { remote.getFd(), POLLIN, 0 };
+        poll(&fd, 1, 1000);
+        if(remote.processReplies() < 0){
+            fprintf(stderr, "IO error\n");
+            return 1;
+        }
+    }
+    report("pipelined", latencies, MockNav2Server::now() - start);
+
+    //control cycles, a velocity command followed by a blocking query, with two writes or one
+    for(int batched = 0; batched < 2; ++batched){
+        latencies.clear();
+        start = MockNav2Server::now();
+        for(int i = 0; i < iterations; ++i){
+            double t = MockNav2Server::now();
+            if(batched){
+                remote.beginBatch();
+            }
+            remote.setRelativeVelocity(0.0, 0.0, 0.0);
+            int rc = remote.estimatePosition(x, y, th);
+            if(remote.commitBatch() < 0 || rc < 0){
+                fprintf(stderr, "IO error\n");
+                return 1;
+            }
+            latencies.push_back(MockNav2Server::now() - t);
+        }
+        report(batched ? "v+q batch" : "v+q", latencies, MockNav2Server::now() - start);
+    }
+
+    server.stop();
+    return 0;
+}
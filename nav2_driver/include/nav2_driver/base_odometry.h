@@ -0,0 +1,340 @@
+#ifndef NAV2_DRIVER_BASE_ODOMETRY_H
+#define NAV2_DRIVER_BASE_ODOMETRY_H
+
+#include <ros/ros.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <nav_msgs/Odometry.h>
+#include <tf/transform_datatypes.h>
+
+#include <nav2_driver/velocity_estimator.h>
+
+#include <boost/array.hpp>
+
+#include <cmath>
+#include <string>
+
+namespace nav2_driver{
+
+/**
+ * @brief Structure for storing pose representation in 2D
+ */
+struct Pose2D{
+
+    Pose2D() : x(0), y(0), th(0) {}
+    Pose2D(double x, double y, double th) : x(x), y(y), th(th) {}
+    double x, y, th;
+    Pose2D& operator +=(Pose2D const& other) {
+        x += other.x;
+        y += other.y;
+        th += other.th;
+        return *this;
+    }
+    Pose2D& operator -=(Pose2D const& other) {
+        x -= other.x;
+        y -= other.y;
+
+        //detect rollover during velocity calculation
+        if(std::fabs(th - other.th) > M_PI){
+            if(other.th>0){
+                th += 2*M_PI;
+            }else{
+                th -= 2*M_PI;
+            }
+        }
+        th -= other.th;
+        return *this;
+    }
+    Pose2D& operator /=(double const& other) {
+        x /= other;
+        y /= other;
+        th /= other;
+        return *this;
+    }
+    inline Pose2D operator +(const Pose2D& other) const { return Pose2D(*this) += other; }
+    inline Pose2D operator -(const Pose2D& other) const { return Pose2D(*this) -= other; }
+    inline Pose2D operator /(const double& other) const { return Pose2D(*this) /= other; }
+
+};
+
+/**
+ * @brief Covariance of the published odometry pose and twist, row-major over x, y, z, roll, pitch and yaw
+ */
+struct OdometryCovariance{
+
+    typedef boost::array<double, 36> Matrix;
+
+    /**
+     * @brief Planar defaults: x, y and yaw are measured, z, roll and pitch are effectively unknown
+     */
+    OdometryCovariance() : adaptive_twist(false) {
+        const double diagonal[] = { 1e-3, 1e-3, 1e6, 1e6, 1e6, 1e3 };
+        pose.assign(0.0);
+        twist.assign(0.0);
+        for(int i = 0; i < 6; ++i){
+            pose[i * 7] = twist[i * 7] = diagonal[i];
+        }
+    }
+
+    /**
+     * @brief Read a matrix parameter, given either as the 6 diagonal values or all 36 values
+     * @param nh Node handle to read from
+     * @param name Parameter name
+     * @param matrix Set to the parameter value, untouched if the parameter is not set
+     * @return false if the parameter is set but is not a valid covariance
+     */
+    static bool load(const ros::NodeHandle& nh, const std::string& name, Matrix& matrix){
+
+        XmlRpc::XmlRpcValue value;
+        if(!nh.getParam(name, value)){
+            return true;
+        }
+        if(value.getType() != XmlRpc::XmlRpcValue::TypeArray || (value.size() != 6 && value.size() != 36)){
+            return false;
+        }
+
+        Matrix loaded;
+        loaded.assign(0.0);
+        for(int i = 0; i < value.size(); ++i){
+            double element;
+            if(value[i].getType() == XmlRpc::XmlRpcValue::TypeDouble){
+                element = static_cast<double>(value[i]);
+            }else if(value[i].getType() == XmlRpc::XmlRpcValue::TypeInt){
+                element = static_cast<int>(value[i]);
+            }else{
+                return false;
+            }
+            loaded[value.size() == 6 ? i * 7 : i] = element;
+        }
+        for(int i = 0; i < 6; ++i){
+            if(!(loaded[i * 7] >= 0.0)){
+                return false;
+            }
+        }
+        matrix = loaded;
+        return true;
+
+    }
+
+    Matrix pose, twist;
+
+    //add the measured variance of the velocity estimate to the twist diagonal of every message
+    bool adaptive_twist;
+
+};
+
+/**
+ * @brief Fills in the parts of an outgoing odometry message and transform that never change, so that publishing only
+ * has to update the pose, twist and stamps
+ * @param prefix Prefix for all frame ids, eg for multiple robots
+ * @param invert_odom Transform goes from base_footprint to odom, for use with robot_pose_ekf
+ * @param covariance Pose and twist covariance
+ * @param message Odometry message template to fill
+ * @param transform Odometry transform template to fill
+ */
+inline void initOdometryMessages(const std::string& prefix, bool invert_odom, const OdometryCovariance& covariance,
+                                 nav_msgs::Odometry& message, geometry_msgs::TransformStamped& transform){
+
+    std::string odom_frame = prefix + "odom";
+    std::string base_footprint_frame = prefix + "base_footprint";
+
+    //invert odometry if necessary
+    if(invert_odom){
+        transform.header.frame_id = base_footprint_frame;
+        transform.child_frame_id = odom_frame;
+    }else{
+        transform.header.frame_id = odom_frame;
+        transform.child_frame_id = base_footprint_frame;
+    }
+
+    message.header.frame_id = odom_frame;
+    message.child_frame_id = prefix + "base_link";
+    message.pose.pose.position.z = 0.0;
+    message.pose.covariance = covariance.pose;
+    message.twist.covariance = covariance.twist;
+
+}
+
+/**
+ * @brief Fills in the fixed base_footprint to base_link transform, published once on the static tf topic
+ * @param prefix Prefix for all frame ids, eg for multiple robots
+ * @param transform Transform to fill
+ */
+inline void initStaticTransform(const std::string& prefix, geometry_msgs::TransformStamped& transform){
+
+    transform.header.stamp = ros::Time::now();
+    transform.header.frame_id = prefix + "base_footprint";
+    transform.child_frame_id = prefix + "base_link";
+    transform.transform.translation.x = 0.0;
+    transform.transform.translation.y = 0.0;
+    transform.transform.translation.z = 0.0;
+    transform.transform.rotation.x = 0.0;
+    transform.transform.rotation.y = 0.0;
+    transform.transform.rotation.z = 0.0;
+    transform.transform.rotation.w = 1.0;
+
+}
+
+/**
+ * @brief Class for building and representing the base odometry state.
+ */
+class BaseOdometry{
+
+public:
+
+    /**
+     * @brief Initialize state to 0,0,0
+     */
+    BaseOdometry(): last_time_(ros::Time::now()) {}
+
+    /**
+     * @brief Initialize state with offset, usually if connection to base was reset
+     * @param offset Pose offset to use
+     * @param estimator Velocity estimator configuration, any samples it holds are dropped
+     */
+    BaseOdometry(Pose2D offset, const VelocityEstimator& estimator = VelocityEstimator()):
+        offset_(offset), last_time_(ros::Time::now()), estimator_(estimator) {
+        estimator_.reset();
+    }
+
+    void updateWithAbsolute(Pose2D abs){
+        updateWithAbsolute(abs, ros::Time::now());
+    }
+
+    void updateWithRelative(Pose2D delta){
+        updateWithRelative(delta, ros::Time::now());
+    }
+
+    /**
+     * @brief Update state with an absolute pose sampled at the given time
+     * @param abs Pose reported by the base
+     * @param stamp Estimated time the base sampled the pose
+     */
+    void updateWithAbsolute(Pose2D abs, const ros::Time& stamp){
+        updateWithRelative(abs - prev_, stamp);
+        prev_ = abs;
+    }
+
+    /**
+     * @brief Update state with pose change since the previous sample
+     * @param delta Pose change
+     * @param stamp Estimated time the base sampled the pose
+     */
+    void updateWithRelative(Pose2D delta, const ros::Time& stamp){
+        last_time_ = stamp;
+        pose_ += delta;
+
+        //pose_ is never wrapped, so it can be fed to the estimator as is
+        double position[] = { pose_.x, pose_.y, pose_.th };
+        double velocity[VelocityEstimator::AXES];
+        estimator_.update(stamp.toSec(), position, velocity);
+        vel_ = Pose2D(velocity[0], velocity[1], velocity[2]);
+
+    }
+
+    /**
+     * @brief Update transform from internal odometry state. Frame ids are left untouched.
+     * @param invert_odom Invert odometry for use with robot_pose_ekf
+     * @param transform Transform to update
+     */
+    void fillTransform(bool invert_odom, geometry_msgs::TransformStamped& transform) const{
+
+        transform.header.stamp = last_time_;
+
+        //invert odometry if necessary
+        tf::Transform temp = tf::Transform(tf::createQuaternionFromYaw(pose_.th + offset_.th), tf::Vector3(pose_.x + offset_.x, pose_.y + offset_.y, 0));
+        if(invert_odom){
+            temp = temp.inverse();
+        }
+        tf::transformTFToMsg(temp, transform.transform);
+
+    }
+
+    /**
+     * @brief Update Odometry message from internal odometry state, with the twist in the child frame. Frame ids and
+     * covariance are left untouched.
+     * @param message Odometry message to update
+     */
+    void fillMessage(nav_msgs::Odometry& message) const{
+
+        message.header.stamp = last_time_;
+        message.pose.pose.position.x = pose_.x + offset_.x;
+        message.pose.pose.position.y = pose_.y + offset_.y;
+        message.pose.pose.orientation = tf::createQuaternionMsgFromYaw(pose_.th + offset_.th);
+
+        Pose2D velocity = getBaseVelocity();
+        message.twist.twist.linear.x = velocity.x;
+        message.twist.twist.linear.y = velocity.y;
+        message.twist.twist.angular.z = velocity.th;
+
+    }
+
+    /**
+     * @brief Update the measured axes of the twist covariance, x, y and yaw, to the configured covariance plus the
+     * variance of the velocity estimate, or just the configured covariance while the estimator measures none
+     * @param twist Configured twist covariance
+     * @param message Odometry message to update
+     */
+    void fillTwistCovariance(const OdometryCovariance::Matrix& twist, nav_msgs::Odometry& message) const{
+
+        double variance[VelocityEstimator::AXES] = { 0.0, 0.0, 0.0 };
+        estimator_.getVariance(variance);
+        message.twist.covariance[0] = twist[0] + variance[0];
+        message.twist.covariance[7] = twist[7] + variance[1];
+        message.twist.covariance[35] = twist[35] + variance[2];
+
+    }
+
+    /**
+     * @brief Get current odometry pose
+     * @return current odometry pose
+     */
+    Pose2D getPose(){
+        return pose_;
+    }
+
+    /**
+     * @brief Get current odometry pose including the offset, as published
+     * @return published odometry pose
+     */
+    Pose2D getOffsetPose() const{
+        return Pose2D(pose_.x + offset_.x, pose_.y + offset_.y, pose_.th + offset_.th);
+    }
+
+    /**
+     * @brief Get current velocity estimate in the odom frame, as estimated from the change in pose
+     * @return velocity estimate, th being the angular velocity
+     * @see getBaseVelocity
+     */
+    Pose2D getVelocity() const{
+        return vel_;
+    }
+
+    /**
+     * @brief Get current velocity estimate rotated into the base frame, as published in the odometry twist
+     * @return velocity estimate, th being the angular velocity
+     */
+    Pose2D getBaseVelocity() const{
+        double th = pose_.th + offset_.th;
+        return Pose2D(std::cos(th) * vel_.x + std::sin(th) * vel_.y, -std::sin(th) * vel_.x + std::cos(th) * vel_.y,
+                      vel_.th);
+    }
+
+    /**
+     * @brief Get time of the latest odometry sample
+     * @return sample time
+     */
+    ros::Time getStamp() const{
+        return last_time_;
+    }
+
+private:
+
+    Pose2D pose_, vel_, prev_, offset_;
+    ros::Time last_time_;
+    VelocityEstimator estimator_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef NAV2_DRIVER_COMMAND_COALESCER_H
+#define NAV2_DRIVER_COMMAND_COALESCER_H
+
+#include <algorithm>
+#include <limits>
+
+namespace nav2_driver{
+
+/**
+ * @brief Decides when to send goals that arrive faster than the base controller should receive them.
+ *
+ * Only the newest offered goal is kept. It is sent at most max_rate times per second, and not at all if it is within
+ * epsilon of the goal last sent. Repeats of an unchanged goal still go out every keepalive seconds, so the base does
+ * not time out while the goal is being held, but nothing is repeated once goals stop arriving. Times are in seconds
+ * on any monotonic-enough clock.
+ *
+ * Command must provide double distance(const Command& other) const, eg the largest component difference.
+ */
+template<class Command>
+class CommandCoalescer{
+
+public:
+
+    /**
+     * @param max_rate Highest send rate in Hz, or 0 for no limit
+     * @param epsilon Goals closer than this to the last one sent are skipped
+     * @param keepalive Send an unchanged goal anyway if the last send is this many seconds ago, or never if 0
+     */
+    explicit CommandCoalescer(double max_rate = 0.0, double epsilon = 0.0, double keepalive = 0.0) :
+        min_period_(max_rate > 0.0 ? 1.0 / max_rate : 0.0),
+        epsilon_(epsilon),
+        keepalive_(keepalive),
+        last_send_(-std::numeric_limits<double>::max()),
+        has_goal_(false),
+        has_sent_(false),
+        coalesced_(0),
+        skipped_(0),
+        keepalives_(0)
+    {}
+
+    /**
+     * @brief Replace the goal waiting to be sent
+     */
+    void offer(const Command& goal){
+        if(has_goal_){
+            ++coalesced_;
+        }
+        goal_ = goal;
+        has_goal_ = true;
+    }
+
+    /**
+     * @brief Check whether a goal should be sent now
+     * @param now Current time
+     * @param command Set to the goal to send, when returning true
+     * @return true if command should be sent, the caller then counts it as sent
+     */
+    bool poll(double now, Command& command){
+        if(!has_goal_ || now < last_send_ + min_period_){
+            return false;
+        }
+        has_goal_ = false;
+
+        if(has_sent_ && goal_.distance(sent_) <= epsilon_){
+            if(keepalive_ <= 0.0 || now < last_send_ + keepalive_){
+                ++skipped_;
+                return false;
+            }
+            ++keepalives_;
+        }
+
+        sent_ = goal_;
+        has_sent_ = true;
+        last_send_ = now;
+        command = sent_;
+        return true;
+    }
+
+    /**
+     * @brief Get the time poll() next has something to do, or the largest double if nothing
+     */
+    double getNextDue() const{
+        return has_goal_ ? last_send_ + min_period_ : std::numeric_limits<double>::max();
+    }
+
+    /**
+     * @brief Forget the waiting and the last sent goal, eg after reconnecting, so the next goal is always sent
+     */
+    void reset(){
+        has_goal_ = false;
+        has_sent_ = false;
+    }
+
+    /**
+     * @brief Get the number of goals replaced by a newer one before being sent
+     */
+    unsigned long getCoalesced() const { return coalesced_; }
+
+    /**
+     * @brief Get the number of goals skipped for being within epsilon of the last one sent
+     */
+    unsigned long getSkipped() const { return skipped_; }
+
+    /**
+     * @brief Get the number of unchanged goals sent as keepalives
+     */
+    unsigned long getKeepalives() const { return keepalives_; }
+
+private:
+
+    double min_period_, epsilon_, keepalive_;
+    double last_send_;
+    Command goal_, sent_;
+    bool has_goal_, has_sent_;
+    unsigned long coalesced_, skipped_, keepalives_;
+
+};
+
+}
+
+#endif
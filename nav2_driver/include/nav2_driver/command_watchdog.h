@@ -0,0 +1,100 @@
+#ifndef NAV2_DRIVER_COMMAND_WATCHDOG_H
+#define NAV2_DRIVER_COMMAND_WATCHDOG_H
+
+#include <limits>
+
+#include <time.h>
+
+namespace nav2_driver{
+
+/**
+ * @brief Deadline for stopping the base once velocity commands go stale.
+ *
+ * Every command that moves the base pushes the deadline timeout seconds into the future, and a command to stand still
+ * clears it, since there is nothing left to stop. Once the deadline has passed the owner sends a stop, which needs no
+ * reply, and reports it with stopped(). Times are in seconds on the monotonic clock, see now().
+ */
+class CommandWatchdog{
+
+public:
+
+    /**
+     * @param timeout Seconds without a command before stopping, or 0 to disable
+     */
+    explicit CommandWatchdog(double timeout = 0.0) :
+        timeout_(timeout),
+        deadline_(std::numeric_limits<double>::max())
+    {}
+
+    /**
+     * @brief Check whether the watchdog does anything at all
+     */
+    bool isEnabled() const { return timeout_ > 0.0; }
+
+    /**
+     * @brief Get the timeout in seconds
+     */
+    double getTimeout() const { return timeout_; }
+
+    /**
+     * @brief Record a velocity command
+     * @param now Current monotonic time
+     * @param moving Whether the command moves the base
+     */
+    void feed(double now, bool moving){
+        deadline_ = moving && timeout_ > 0.0 ? now + timeout_ : std::numeric_limits<double>::max();
+    }
+
+    /**
+     * @brief Clear the deadline, eg when the base is handed queued motions that run without velocity commands
+     */
+    void disarm(){
+        deadline_ = std::numeric_limits<double>::max();
+    }
+
+    /**
+     * @brief Check whether a deadline is set
+     */
+    bool isArmed() const { return deadline_ < std::numeric_limits<double>::max(); }
+
+    /**
+     * @brief Get the deadline, or the largest double if disarmed
+     */
+    double getDeadline() const { return deadline_; }
+
+    /**
+     * @brief Check whether the base should be stopped now. Stays true until stopped() or a new command.
+     * @param now Current monotonic time
+     */
+    bool due(double now) const { return now >= deadline_; }
+
+    /**
+     * @brief Record that the stop went out, and disarm until the next command
+     * @param now Current monotonic time
+     * @return How late the stop was, after the deadline
+     */
+    double stopped(double now){
+        double latency = now - deadline_;
+        deadline_ = std::numeric_limits<double>::max();
+        return latency;
+    }
+
+    /**
+     * @brief Current monotonic time in seconds, immune to wall clock steps
+     */
+    static double now(){
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+private:
+
+    double timeout_;
+    double deadline_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef NAV2_DRIVER_LATENCY_HISTOGRAM_H
+#define NAV2_DRIVER_LATENCY_HISTOGRAM_H
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+
+namespace nav2_driver{
+
+/**
+ * @brief Lock-free histogram of durations with power-of-two microsecond buckets.
+ *
+ * Recording is a few relaxed atomic increments, so it can be left on in hot paths and called from any thread.
+ * Statistics are read through a Window, normally taken once per report so that they follow current latency instead of
+ * everything since startup. Percentiles are only as precise as the buckets, ie reported as the upper edge of the
+ * bucket they fall in.
+ */
+class LatencyHistogram{
+
+public:
+
+    enum { BUCKETS = 32 };
+
+    /**
+     * @brief Copy of the durations recorded over some period, see take()
+     */
+    class Window{
+
+    public:
+
+        Window() : count_(0), sum_us_(0), max_us_(0) {
+            for(int i = 0; i < BUCKETS; ++i){
+                buckets_[i] = 0;
+            }
+        }
+
+        /**
+         * @brief Get the number of recorded durations
+         */
+        boost::uint64_t getCount() const { return count_; }
+
+        /**
+         * @brief Get the mean duration in seconds, 0 if empty
+         */
+        double getMean() const { return count_ ? sum_us_ * 1e-6 / count_ : 0.0; }
+
+        /**
+         * @brief Get the longest recorded duration in seconds
+         */
+        double getMax() const { return max_us_ * 1e-6; }
+
+        /**
+         * @brief Get an upper bound for the given percentile in seconds, 0 if empty
+         * @param fraction Percentile as a fraction, eg 0.99
+         */
+        double getPercentile(double fraction) const {
+            boost::uint64_t total = 0;
+            for(int i = 0; i < BUCKETS; ++i){
+                total += buckets_[i];
+            }
+
+            boost::uint64_t rank = (boost::uint64_t)(fraction * total), seen = 0;
+            for(int i = 0; i < BUCKETS; ++i){
+                seen += buckets_[i];
+                if(seen > rank){
+                    return std::min((double)(1ULL << i), (double)max_us_) * 1e-6;
+                }
+            }
+            return getMax();
+        }
+
+    private:
+
+        friend class LatencyHistogram;
+
+        boost::uint64_t buckets_[BUCKETS];
+        boost::uint64_t count_, sum_us_, max_us_;
+
+    };
+
+    LatencyHistogram() : total_(0), count_(0), sum_us_(0), max_us_(0) {
+        for(int i = 0; i < BUCKETS; ++i){
+            buckets_[i] = 0;
+        }
+    }
+
+    /**
+     * @brief Record one duration
+     * @param seconds Duration in seconds, negative values count as zero
+     */
+    void record(double seconds){
+        boost::uint64_t us = seconds > 0.0 ? (boost::uint64_t)(seconds * 1e6) : 0;
+
+        //bucket i holds durations below 2^i us
+        int bucket = 0;
+        for(boost::uint64_t v = us; v && bucket < BUCKETS - 1; v >>= 1){
+            ++bucket;
+        }
+        buckets_[bucket].fetch_add(1, boost::memory_order_relaxed);
+        total_.fetch_add(1, boost::memory_order_relaxed);
+        count_.fetch_add(1, boost::memory_order_relaxed);
+        sum_us_.fetch_add(us, boost::memory_order_relaxed);
+
+        boost::uint64_t max = max_us_.load(boost::memory_order_relaxed);
+        while(us > max && !max_us_.compare_exchange_weak(max, us, boost::memory_order_relaxed)) {}
+    }
+
+    /**
+     * @brief Get the durations recorded since the previous take(), or since construction, and start a new window.
+     * A duration recorded concurrently lands in one window or the other, so its statistics may be off by one sample.
+     */
+    Window take(){
+        Window window;
+        for(int i = 0; i < BUCKETS; ++i){
+            window.buckets_[i] = buckets_[i].exchange(0, boost::memory_order_relaxed);
+        }
+        window.count_ = count_.exchange(0, boost::memory_order_relaxed);
+        window.sum_us_ = sum_us_.exchange(0, boost::memory_order_relaxed);
+        window.max_us_ = max_us_.exchange(0, boost::memory_order_relaxed);
+        return window;
+    }
+
+    /**
+     * @brief Get the number of durations recorded since construction, across all windows
+     */
+    boost::uint64_t getTotal() const {
+        return total_.load(boost::memory_order_relaxed);
+    }
+
+private:
+
+    // No copying allowed
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+
+    boost::atomic<boost::uint64_t> buckets_[BUCKETS];
+    boost::atomic<boost::uint64_t> total_, count_, sum_us_, max_us_;
+
+};
+
+}
+
+#endif
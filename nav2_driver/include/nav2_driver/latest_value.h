@@ -0,0 +1,60 @@
+#ifndef NAV2_DRIVER_LATEST_VALUE_H
+#define NAV2_DRIVER_LATEST_VALUE_H
+
+#include <boost/atomic.hpp>
+
+namespace nav2_driver{
+
+/**
+ * @brief Lock-free single-producer, single-consumer mailbox that only keeps the most recent value.
+ *
+ * Implemented as a triple buffer: the producer and consumer each own one slot, and the third slot is exchanged
+ * atomically between them. Writing never waits for the reader, and a value that is overwritten before it is read is
+ * dropped (latest wins).
+ */
+template <typename T>
+class LatestValue{
+
+public:
+
+    LatestValue() : middle_(1), write_(0), read_(2) {}
+
+    /**
+     * @brief Publish a new value, replacing any unread one. Producer thread only.
+     */
+    void write(const T& value){
+        buffers_[write_] = value;
+        write_ = middle_.exchange(write_ | FRESH, boost::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    /**
+     * @brief Take the latest value if one was written since the last read. Consumer thread only.
+     * @param value Output for the latest value, untouched if there is none
+     * @return true if a new value was read
+     */
+    bool read(T& value){
+        if(!(middle_.load(boost::memory_order_relaxed) & FRESH)){
+            return false;
+        }
+        read_ = middle_.exchange(read_, boost::memory_order_acq_rel) & INDEX_MASK;
+        value = buffers_[read_];
+        return true;
+    }
+
+private:
+
+    enum { INDEX_MASK = 3, FRESH = 4 };
+
+    // No copying allowed
+    LatestValue(const LatestValue&);
+    LatestValue& operator=(const LatestValue&);
+
+    T buffers_[3];
+    boost::atomic<unsigned int> middle_;
+    unsigned int write_, read_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef NAV2_DRIVER_MESSAGE_POOL_H
+#define NAV2_DRIVER_MESSAGE_POOL_H
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace nav2_driver{
+
+/**
+ * @brief Recycles outgoing messages that are published by shared pointer for zero-copy intra-process delivery.
+ *
+ * A message is free again once the publisher queue and all intra-process subscribers have released it. The pool only
+ * grows until it covers the number of messages subscribers hold on to. Not thread-safe.
+ */
+template<class Message>
+class MessagePool{
+
+public:
+
+    /**
+     * @param prototype New messages are copies of this, eg with frame ids and covariance filled in
+     */
+    explicit MessagePool(const Message& prototype = Message()) : prototype_(prototype) {}
+
+    /**
+     * @brief Get a message to fill in and publish, still holding whatever it was last published with
+     */
+    boost::shared_ptr<Message> next(){
+        for(typename std::vector<boost::shared_ptr<Message> >::iterator it = pool_.begin(); it != pool_.end(); ++it){
+            if(it->unique()){
+                return *it;
+            }
+        }
+        pool_.push_back(boost::make_shared<Message>(prototype_));
+        return pool_.back();
+    }
+
+private:
+
+    Message prototype_;
+    std::vector<boost::shared_ptr<Message> > pool_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,339 @@
+#ifndef NAV2_DRIVER_NAV2_DRIVER_H
+#define NAV2_DRIVER_NAV2_DRIVER_H
+
+#include <ros/ros.h>
+#include <geometry_msgs/Twist.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <nav_msgs/Odometry.h>
+#include <tf2_msgs/TFMessage.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <actionlib/server/simple_action_server.h>
+#include <dynamic_reconfigure/server.h>
+
+#include <nav2_driver/MotionAction.h>
+#include <nav2_driver/Nav2DriverConfig.h>
+#include <nav2_driver/nav2remote.h>
+#include <nav2_driver/traffic_log.h>
+#include <nav2_driver/transform_cache.h>
+#include <nav2_driver/base_odometry.h>
+#include <nav2_driver/latest_value.h>
+#include <nav2_driver/seqlock.h>
+#include <nav2_driver/shm_odometry.h>
+#include <nav2_driver/poll_scheduler.h>
+#include <nav2_driver/latency_histogram.h>
+#include <nav2_driver/command_coalescer.h>
+#include <nav2_driver/command_watchdog.h>
+#include <nav2_driver/message_pool.h>
+#include <nav2_driver/velocity_command.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace nav2_driver{
+
+/**
+ * @brief ROS Driver/Wrapper for nav2remote Remote API, implementing standard mobile robot subscribers, publishers, and tf frames as per REP 105.
+ *
+ * The socket has a single owner: the ROS callbacks with a single threaded spinner, or the I/O thread, which is always
+ * used when the callbacks may run on several threads (spinner_threads > 1). Callbacks then only exchange state with
+ * the I/O thread through lock-free mailboxes, snapshots and atomic counters.
+ */
+class Nav2Driver{
+
+public:
+
+    /**
+     * @brief Constructor for driver, used by both the standalone node and the nodelet
+     * @param nh Node handle for topics
+     * @param private_nh Node handle for parameters
+     */
+    Nav2Driver(ros::NodeHandle nh, ros::NodeHandle private_nh);
+
+    ~Nav2Driver();
+
+protected:
+
+    /**
+     * @brief Checks for a usable connection, taking over one just established by the reconnect thread if necessary.
+     * Never blocks on the network. Only called from the thread that owns remote_.
+     * @return true if remote_ can be used
+     */
+    bool haveRemote();
+
+    /**
+     * @brief Drops the current connection after an IO error and asks the reconnect thread for a new one, saving the
+     * odometry offset for the new base connection. Returns immediately.
+     */
+    void linkDown();
+
+    /**
+     * @brief Reconnect thread, establishes connections to the Nav2 base controller with a connect timeout and
+     * exponential backoff with jitter between failed attempts, then hands them over to the owner of remote_
+     */
+    void reconnectLoop();
+
+    /**
+     * @brief Publishes odometry message and transform for the given state, reusing the preallocated instances
+     * @param odom Odometry state to publish
+     */
+    void publishState(const BaseOdometry& odom);
+
+    /**
+     * @brief Records the round trip of a position query and estimates when the base sampled the position, half a
+     * smoothed round trip before the reply arrived
+     * @param sent Time the query was sent, as from Nav2Remote::getQueryTime
+     * @param received Time the reply was received, as from Nav2Remote::getReplyTime
+     * @return ROS time stamp for the sample
+     */
+    ros::Time stampSample(double sent, double received);
+
+    /**
+     * @brief Retrieves latest odometry information from the base controller, and publishes appropriate message and transforms
+     */
+    void publishOdometry(const ros::TimerEvent&);
+
+    /**
+     * @brief Sets velocity goals for base controller
+     * @param twist Incoming velocity command from ROS
+     */
+    void setVelocity(const geometry_msgs::TwistConstPtr& twist);
+
+    /**
+     * @brief Timer callback that sends a velocity goal held back by the rate limit
+     */
+    void sendVelocity(const ros::TimerEvent&);
+
+    /**
+     * @brief Sends the newest velocity goal if the coalescer allows it, dropping it while the link is down
+     * @param now Current wall time
+     */
+    void flushVelocity(double now);
+
+    /**
+     * @brief Pushes the watchdog deadline back for a velocity command, and reschedules its timer. Only called from
+     * the thread that owns remote_.
+     * @param command Velocity command just received
+     */
+    void feedWatchdog(const VelocityCommand& command);
+
+    /**
+     * @brief Points the watchdog timer at the current deadline: the I/O thread's timerfd, or a one-shot wall timer
+     */
+    void armWatchdogTimer();
+
+    /**
+     * @brief Stops the base once velocity commands are stale. The stop needs no reply, so this never waits on the
+     * link; while the link is down the stop is sent as soon as it is back. Only called from the thread that owns
+     * remote_.
+     */
+    void checkWatchdog();
+
+    /**
+     * @brief Watchdog timer callback without the I/O thread
+     */
+    void watchdogTimeout(const ros::WallTimerEvent&);
+
+    /**
+     * @brief Socket I/O thread, sole user of remote_ in threaded mode. Sends the newest velocity command as soon as it
+     * arrives, and keeps one position query in flight per odometry period without blocking on the reply. Commands due
+     * in the same iteration go out in one batch.
+     */
+    void ioLoop();
+
+    /**
+     * @brief Starts the position stream on the current connection, unless it is running already
+     * @return 0 on success, non-zero on IO error
+     */
+    int startStream();
+
+    /**
+     * @brief Position reply handler for the I/O thread and the position stream, updates odometry state and snapshots
+     * it for publishing
+     */
+    void handlePosition(int rc, double x, double y, double th);
+
+    /**
+     * @brief Action server callback for a new motion goal, hands it to the owner of remote_
+     */
+    void motionGoal();
+
+    /**
+     * @brief Action server callback for a cancelled motion goal, hands the cancel to the owner of remote_
+     */
+    void motionPreempt();
+
+    /**
+     * @brief Starts or cancels the motion goal handed over by the action server callbacks. Only called from the thread
+     * that owns remote_.
+     */
+    void runMotion();
+
+    /**
+     * @brief Completion handler for the primitives of a motion goal
+     * @param generation Goal the handler belongs to, stale goals are ignored
+     * @param rc Completion status from Nav2Remote
+     */
+    void motionDone(unsigned long generation, int rc);
+
+    /**
+     * @brief Publishes motion feedback once more primitives have completed, as seen in the latest position reply
+     */
+    void updateMotionFeedback();
+
+    /**
+     * @brief Ends the active motion goal, if any, as aborted
+     * @param reason Text for the goal status
+     */
+    void abortMotion(const std::string& reason);
+
+    /**
+     * @brief Reconfigure callback, retimes snapshot publishing and hands the new settings to the owner of remote_
+     * @param config New configuration
+     * @param level Bitwise or of the ReconfigureLevel of every changed parameter
+     */
+    void reconfigure(Nav2DriverConfig& config, uint32_t level);
+
+    /**
+     * @brief Applies settings handed over by the reconfigure callback, and sends changed turtle command limits in one
+     * batch, again on every new connection. Only called from the thread that owns remote_.
+     */
+    void applyConfig();
+
+    /**
+     * @brief Wake the I/O thread from poll()
+     */
+    void wake();
+
+    /**
+     * @brief Copies the poll scheduler's link timing into the snapshot read by diagnostics. Only called from the
+     * thread that owns remote_.
+     */
+    void updateLinkStats();
+
+    /**
+     * @brief Fills diagnostic status with link and callback timing statistics
+     * @param stat Status to fill
+     */
+    void updateDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat);
+
+    /**
+     * @brief Timer callback that lets the diagnostic updater publish at its own low rate
+     */
+    void publishDiagnostics(const ros::TimerEvent&);
+
+private:
+
+    //levels of the parameters in cfg/Nav2Driver.cfg
+    enum ReconfigureLevel{
+        RECONFIGURE_LIMITS = 1,
+        RECONFIGURE_POLL = 2
+    };
+
+    ros::NodeHandle nh_;
+    ros::NodeHandle private_nh_;
+    tf2_ros::StaticTransformBroadcaster static_broadcaster_;
+
+    //optional record of the link traffic, declared before the connections so that it outlives them
+    boost::shared_ptr<TrafficLog> traffic_log_;
+
+    //only used by the owning thread: the ROS callbacks, or the I/O thread in threaded mode
+    boost::shared_ptr<Nav2Remote> remote_;
+
+    //connection handoff from the reconnect thread, only locked when a new connection is ready
+    boost::thread reconnect_thread_;
+    boost::mutex link_mutex_;
+    boost::condition_variable link_cond_;
+    boost::shared_ptr<Nav2Remote> pending_remote_;
+    bool reconnect_requested_, reconnect_running_;
+    boost::atomic<bool> remote_pending_, link_up_;
+    double connect_timeout_, backoff_min_, backoff_max_;
+    Nav2Remote::SocketOptions socket_options_;
+
+    ros::Publisher odom_pub_;
+    ros::Subscriber cmd_sub_;
+    ros::Timer cmd_timer_;
+    ros::Timer odom_loop_;
+    BaseOdometry base_odom_;
+    VelocityEstimator velocity_estimator_;
+    OdometryCovariance odom_covariance_;
+
+    //outgoing messages are published by shared pointer for zero-copy intra-process delivery, and recycled from a pool
+    //once no subscriber holds them any more
+    MessagePool<nav_msgs::Odometry> odom_pool_;
+    ros::Publisher tf_pub_;
+    MessagePool<tf2_msgs::TFMessage> tf_pool_;
+    TransformCache odom_transform_;
+    BaseOdometry odom_published_;
+
+    //optional copy of every published sample for consumers on the same host, see ShmOdometryReader
+    boost::shared_ptr<ShmOdometryWriter> odom_shm_;
+
+    std::string robot_address_, robot_prefix_;
+    int robot_port_;
+    bool invert_odom_;
+
+    bool io_thread_;
+    boost::thread io_thread_handle_;
+    boost::atomic<bool> io_running_;
+    int wake_fd_;
+    LatestValue<VelocityCommand> cmd_mailbox_;
+
+    //only used by the owner of remote_, counts are copied out for diagnostics
+    CommandCoalescer<VelocityCommand> cmd_coalescer_;
+    boost::atomic<unsigned long> cmd_sent_, cmd_coalesced_, cmd_skipped_;
+
+    //stops the base when velocity commands stop arriving, on a monotonic timerfd polled by the I/O thread
+    CommandWatchdog watchdog_;
+    int watchdog_fd_;
+    ros::WallTimer watchdog_timer_;
+    LatestValue<BaseOdometry> odom_snapshot_;
+
+    PollScheduler poll_scheduler_;
+
+    //link timing written by the owner of remote_ after every sample, for diagnostics on any thread
+    struct LinkStats{
+        double period, round_trip;
+        LinkStats() : period(0), round_trip(0) {}
+    };
+    SeqLock<LinkStats> link_stats_;
+    bool odom_stream_;
+    int odom_stream_depth_;
+
+    //motion goals, handed from the action server callbacks to the owner of remote_, which alone touches the rest
+    typedef actionlib::SimpleActionServer<MotionAction> MotionServer;
+    boost::shared_ptr<MotionServer> motion_server_;
+    boost::mutex motion_mutex_;
+    MotionGoalConstPtr motion_goal_;
+    bool motion_cancel_;
+    boost::atomic<bool> motion_ready_;
+    bool motion_active_;
+    unsigned long motion_generation_, motion_base_, motion_count_, motion_reported_;
+
+    //runtime settings, handed over the same way. Limits are only sent when set, negative ones leave the base's own
+    boost::shared_ptr<dynamic_reconfigure::Server<Nav2DriverConfig> > reconfigure_server_;
+    boost::mutex config_mutex_;
+    Nav2DriverConfig config_;
+    uint32_t config_level_;
+    boost::atomic<bool> config_ready_;
+    double max_speed_, max_accel_, max_cornering_error_;
+    bool limits_dirty_;
+
+    //hot path instrumentation, cheap enough to always record and read from any thread
+    LatencyHistogram rtt_hist_, odom_callback_hist_, cmd_callback_hist_, odom_age_hist_, watchdog_hist_;
+    boost::atomic<unsigned long> reconnects_, connect_failures_, poll_overruns_, tf_skipped_;
+
+    diagnostic_updater::Updater diagnostics_;
+    ros::Timer diagnostics_timer_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef NAV2_DRIVER_NAV2_FLEET_DRIVER_H
+#define NAV2_DRIVER_NAV2_FLEET_DRIVER_H
+
+#include <ros/ros.h>
+#include <geometry_msgs/Twist.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <nav_msgs/Odometry.h>
+#include <tf2_msgs/TFMessage.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+
+#include <nav2_driver/nav2remote.h>
+#include <nav2_driver/traffic_log.h>
+#include <nav2_driver/transform_cache.h>
+#include <nav2_driver/base_odometry.h>
+#include <nav2_driver/latest_value.h>
+#include <nav2_driver/poll_scheduler.h>
+#include <nav2_driver/latency_histogram.h>
+#include <nav2_driver/command_coalescer.h>
+#include <nav2_driver/message_pool.h>
+#include <nav2_driver/velocity_command.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+
+#include <string>
+#include <vector>
+
+namespace nav2_driver{
+
+/**
+ * @brief Drives several Nav2 bases from one process: a single epoll loop does all socket I/O, and each robot gets the
+ * same odom/cmd_vel topics and tf frames as a Nav2Driver with robot_name set would.
+ *
+ * Robots are listed in the ~robots parameter, eg [{name: r1, address: 10.0.0.1}, {name: r2, address: 10.0.0.2,
+ * port: 5010}]. All other parameters apply to every robot.
+ */
+class Nav2FleetDriver{
+
+public:
+
+    /**
+     * @brief Constructor for fleet driver
+     * @param nh Node handle for topics, each robot publishes and subscribes under its name
+     * @param private_nh Node handle for parameters
+     */
+    Nav2FleetDriver(ros::NodeHandle nh, ros::NodeHandle private_nh);
+
+    ~Nav2FleetDriver();
+
+protected:
+
+    /**
+     * @brief Per robot state. Only the I/O thread uses the connection and odometry state, the ROS callbacks own the
+     * publishing side, and the two meet in the mailboxes and in the reconnect handoff.
+     */
+    struct Robot{
+
+        size_t index;
+        std::string name, address;
+        int port;
+
+        //ROS callback side
+        ros::Subscriber cmd_sub;
+        ros::Publisher odom_pub;
+        MessagePool<nav_msgs::Odometry> odom_pool;
+        TransformCache odom_transform;
+        BaseOdometry published;
+
+        //handoff between ROS callbacks and the I/O thread
+        LatestValue<VelocityCommand> cmd_mailbox;
+        LatestValue<BaseOdometry> odom_snapshot;
+        boost::atomic<bool> cmd_ready;
+
+        //I/O thread only
+        boost::shared_ptr<Nav2Remote> remote;
+        BaseOdometry odom;
+        PollScheduler poll_scheduler;
+        CommandCoalescer<VelocityCommand> cmd_coalescer;
+        double next_poll;
+
+        //reconnect handoff, guarded by link_mutex_ except for the flags
+        boost::shared_ptr<Nav2Remote> pending_remote;
+        bool reconnect_requested;
+        double next_attempt, backoff;
+        boost::atomic<bool> remote_pending, link_up;
+
+        LatencyHistogram rtt_hist;
+
+        Robot() : index(0), port(5010), cmd_ready(false), next_poll(0), reconnect_requested(true), next_attempt(0),
+                  backoff(0), remote_pending(false), link_up(false) {}
+
+    };
+
+    /**
+     * @brief Reads the robot list and creates each robot's topics
+     */
+    void loadRobots();
+
+    /**
+     * @brief Hands velocity commands for one robot to the I/O thread
+     */
+    void setVelocity(const geometry_msgs::TwistConstPtr& twist, Robot* robot);
+
+    /**
+     * @brief Publishes odometry messages for every robot with a new sample, and all their transforms in one message
+     */
+    void publishOdometry(const ros::TimerEvent&);
+
+    /**
+     * @brief Socket I/O thread, sole user of every robot's connection
+     */
+    void ioLoop();
+
+    /**
+     * @brief Takes over a connection established by the reconnect thread, if any, and adds it to the epoll set
+     * @return true if the robot has a usable connection
+     */
+    bool haveRemote(Robot& robot);
+
+    /**
+     * @brief Drops a robot's connection after an IO error and asks the reconnect thread for a new one
+     */
+    void linkDown(Robot& robot);
+
+    /**
+     * @brief Reconnect thread, connects robots that need it in order of their next attempt, backing off exponentially
+     * with jitter after failures
+     */
+    void reconnectLoop();
+
+    /**
+     * @brief Position reply handler for the I/O thread
+     */
+    void handlePosition(Robot* robot, int rc, double x, double y, double th);
+
+    /**
+     * @brief Wake the I/O thread from epoll_wait()
+     */
+    void wake();
+
+    /**
+     * @brief Fills diagnostic status with per robot link state
+     */
+    void updateDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat);
+
+    /**
+     * @brief Timer callback that lets the diagnostic updater publish at its own low rate
+     */
+    void publishDiagnostics(const ros::TimerEvent&);
+
+private:
+
+    ros::NodeHandle nh_;
+    ros::NodeHandle private_nh_;
+    tf2_ros::StaticTransformBroadcaster static_broadcaster_;
+    ros::Publisher tf_pub_;
+
+    //all robots' odometry transforms, recycled like the odometry messages and filled in robot order
+    MessagePool<tf2_msgs::TFMessage> tf_pool_;
+
+    //optional record of every robot's traffic, tagged by robot index, declared first so that it outlives the robots
+    boost::shared_ptr<TrafficLog> traffic_log_;
+    std::vector<boost::shared_ptr<Robot> > robots_;
+    bool invert_odom_, publish_base_link_, tf_skip_unchanged_;
+    double tf_keepalive_;
+    double odom_rate_;
+    VelocityEstimator velocity_estimator_;
+    OdometryCovariance odom_covariance_;
+    double cmd_rate_max_, cmd_epsilon_, cmd_keepalive_;
+    ros::Timer odom_loop_;
+
+    boost::thread io_thread_;
+    boost::atomic<bool> io_running_;
+    int epoll_fd_, wake_fd_;
+
+    boost::thread reconnect_thread_;
+    boost::mutex link_mutex_;
+    boost::condition_variable link_cond_;
+    bool reconnect_running_;
+    double connect_timeout_, backoff_min_, backoff_max_;
+    Nav2Remote::SocketOptions socket_options_;
+    boost::atomic<unsigned long> reconnects_, connect_failures_, poll_overruns_;
+
+    diagnostic_updater::Updater diagnostics_;
+    ros::Timer diagnostics_timer_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef _NAV2PROTOCOL_H_
+#define _NAV2PROTOCOL_H_
+
+#include <cstring>
+#include <cmath>
+
+/**
+ * @brief
+ * Number formatting and parsing for the Nav2 turtle protocol.
+ *
+ * These functions produce and accept exactly the same text as the
+ * "%lf" conversions of sprintf() and sscanf() in the C locale, but
+ * without going through the locale machinery.  Values that the fast
+ * paths cannot handle exactly (very large magnitudes, exponents, long
+ * mantissas) fall back to the C library, so the results never differ.
+ */
+namespace nav2protocol
+{
+
+/**
+ * @brief Maximum length of a number written by formatDouble(),
+ * excluding the terminating null.
+ */
+enum { MAX_DOUBLE_LENGTH = 24 };
+
+/**
+ * @brief Maximum length of a number written by formatUnsigned().
+ */
+enum { MAX_UNSIGNED_LENGTH = 10 };
+
+/**
+ * @brief Check that formatDouble() accepts a value: it is finite and
+ * of magnitude below 1e16, which the base cannot represent anyway.
+ */
+inline bool canFormat( double value)
+{
+    return fabs(value) < 1e16;
+}
+
+/**
+ * @brief Format a value with six decimals, like sprintf("%lf").
+ *
+ * @param buf Output buffer, at least MAX_DOUBLE_LENGTH+1 bytes.
+ * The result is null terminated.
+ * @param value The value to format.
+ * @return The number of characters written, excluding the null, or -1
+ * with nothing written if canFormat() rejects the value.
+ */
+int formatDouble( char* buf, double value);
+
+/**
+ * @brief Format a 32 bit unsigned value in decimal, like sprintf("%u").
+ *
+ * @param buf Output buffer, at least MAX_UNSIGNED_LENGTH bytes.  The
+ * result is not null terminated.
+ * @param value The value to format.
+ * @return The number of characters written.
+ */
+int formatUnsigned( char* buf, unsigned int value);
+
+/**
+ * @brief Field unit conversions for command descriptors.
+ */
+struct Same
+{
+    static double convert( double value) { return value; }
+};
+
+struct RadiansToDegrees
+{
+    static double convert( double value) { return value * (180.0 / M_PI); }
+};
+
+/**
+ * @brief Command descriptor: opcode length, field count and the unit
+ * conversion of each field.
+ *
+ * Every command derives from this and adds op(), returning its opcode.
+ * BUFFER_SIZE is the most an encoded command can take, including the
+ * newline and the null that formatDouble() writes past the end.
+ */
+template <int OpLength, int Fields, class Unit0 = Same,
+    class Unit1 = Same, class Unit2 = Same>
+struct Command
+{
+    enum {
+        OP_LENGTH = OpLength,
+        FIELDS = Fields,
+        BUFFER_SIZE = OpLength + Fields * (1 + MAX_DOUBLE_LENGTH) + 2
+    };
+    typedef Unit0 Field0;
+    typedef Unit1 Field1;
+    typedef Unit2 Field2;
+};
+
+/**
+ * @brief The Nav2 command set.  Angles are given in radians and sent
+ * in degrees.
+ */
+struct SetTargetOrientation : Command<1, 1> { static const char* op() { return "o"; } };
+struct SetAbsoluteVelocity : Command<2, 2> { static const char* op() { return "av"; } };
+struct SetRelativeVelocity : Command<1, 3, Same, Same, RadiansToDegrees> { static const char* op() { return "v"; } };
+struct SetPosition : Command<1, 3, Same, Same, RadiansToDegrees> { static const char* op() { return "p"; } };
+struct Stop : Command<1, 0> { static const char* op() { return "s"; } };
+struct TurnLeft : Command<2, 1, RadiansToDegrees> { static const char* op() { return "lt"; } };
+struct Move : Command<2, 2, Same, RadiansToDegrees> { static const char* op() { return "mv"; } };
+struct SetMaxSpeed : Command<3, 1> { static const char* op() { return "sms"; } };
+struct SetMaxAccel : Command<3, 1> { static const char* op() { return "sma"; } };
+struct SetMaxCorneringError : Command<4, 1> { static const char* op() { return "smce"; } };
+
+/**
+ * @brief Encode a command line, "<op> <field>...\n".
+ *
+ * The opcode length and field count are compile time constants, so
+ * this unrolls to a copy of the opcode and one formatDouble() per field.
+ *
+ * @param buf Output buffer, at least C::BUFFER_SIZE bytes.
+ * @param args C::FIELDS values, in the caller's units.
+ * @return The length of the line, which is not null terminated, or -1
+ * if a field cannot be formatted.  The buffer contents are undefined
+ * then.
+ */
+template <class C>
+inline int encode( char* buf, const double* args)
+{
+    char* p = buf;
+    memcpy(p, C::op(), C::OP_LENGTH);
+    p += C::OP_LENGTH;
+    int len = 0;
+    if( C::FIELDS > 0) {
+        *p++ = ' ';
+        if( (len = formatDouble(p, C::Field0::convert(args[0]))) < 0) return -1;
+        p += len;
+    }
+    if( C::FIELDS > 1) {
+        *p++ = ' ';
+        if( (len = formatDouble(p, C::Field1::convert(args[1]))) < 0) return -1;
+        p += len;
+    }
+    if( C::FIELDS > 2) {
+        *p++ = ' ';
+        if( (len = formatDouble(p, C::Field2::convert(args[2]))) < 0) return -1;
+        p += len;
+    }
+    *p++ = '\n';
+    return p - buf;
+}
+
+/**
+ * @brief Encode a command for the velocity datagram channel,
+ * "<sequence> <op> <field>...\n".
+ *
+ * The base executes a datagram only if its sequence number is newer
+ * than that of every datagram it has already seen, in 32 bit serial
+ * number arithmetic, so that reordered or duplicated packets are
+ * dropped.
+ *
+ * @param buf Output buffer, at least C::BUFFER_SIZE +
+ * MAX_UNSIGNED_LENGTH + 1 bytes.
+ * @param sequence Sequence number of the datagram.
+ * @param args C::FIELDS values, in the caller's units.
+ * @return The length of the datagram, which is not null terminated, or
+ * -1 if a field cannot be formatted.
+ */
+template <class C>
+inline int encodeSequenced( char* buf, unsigned int sequence, const double* args)
+{
+    int len = formatUnsigned(buf, sequence);
+    buf[len++] = ' ';
+    int cmd = encode<C>(buf + len, args);
+    return cmd < 0 ? -1 : len + cmd;
+}
+
+/**
+ * @brief Parse a floating point number, like sscanf("%lf").
+ *
+ * Leading whitespace is skipped.
+ *
+ * @param str The text to parse.
+ * @param value Output parameter for the parsed value.  Left untouched
+ * if no number could be parsed.
+ * @return Pointer just past the parsed number, or NULL if there was none.
+ */
+const char* parseDouble( const char* str, double& value);
+
+/**
+ * @brief Parse a decimal integer, like sscanf("%d").
+ *
+ * Leading whitespace is skipped.
+ *
+ * @param str The text to parse.
+ * @param value Output parameter for the parsed value.  Left untouched
+ * if no number could be parsed.
+ * @return Pointer just past the parsed number, or NULL if there was none.
+ */
+const char* parseInt( const char* str, int& value);
+
+/**
+ * @brief Parse a position reply, "x y orientation qlen".
+ *
+ * Parsing stops at the first bad field, so the remaining outputs keep
+ * their previous values.
+ *
+ * @param line The reply line.
+ * @param x Output parameter for the x coordinate.
+ * @param y Output parameter for the y coordinate.
+ * @param orientation Output parameter for the orientation, converted
+ * from degrees to radians.
+ * @param qlen Output parameter for the command queue length.
+ */
+void parsePosition( const char* line,
+    double& x, double& y, double& orientation, int& qlen);
+
+}
+
+#endif
@@ -6,6 +6,11 @@
 #ifndef _NAV2REMOTE_H_
 #define _NAV2REMOTE_H_
 
+#include <deque>
+#include <boost/function.hpp>
+
+class TrafficLog;
+
 /**
  * @brief
  * Class for controlling Nav2 via turtle interface.
@@ -20,6 +25,22 @@
  * the robot has completed the requested path.  Call wait() to wait until
  * the queue is empty.
  *
+ * Queries can also be issued asynchronously (eg, estimatePositionAsync()).
+ * The command is written immediately and the reply handler is queued;
+ * replies are matched to handlers in the order the queries were sent,
+ * so several queries may be in flight at once.  Handlers run from inside
+ * processReplies(), flush() or any blocking query.
+ *
+ * Commands and queries can be collected with beginBatch() and sent
+ * together with commitBatch(), in one system call and usually one
+ * packet.  A blocking query issued while batching sends the collected
+ * commands along with it, eg a velocity command and the following
+ * position query.
+ *
+ * A command with an argument the turtle protocol cannot represent (not
+ * finite, or of magnitude 1e16 and above) is not sent at all.  It
+ * returns -1 with errno set to ERANGE, and the connection stays usable.
+ *
  * When this object goes out of scope (eg, when the program finishes),
  * the robot will stop immediately, even if there are commands in the queue.
  * Use wait() if you want to ensure that the path completes.
@@ -30,13 +51,205 @@ class Nav2Remote
     Nav2Remote(const Nav2Remote&);
     Nav2Remote& operator=(const Nav2Remote&);
 
-    mutable char *line;
+    // Receive ring buffer.  rxHead and rxTail run freely and are masked on
+    // access, so RX_BUFFER_SIZE must be a power of two.
+    enum { RX_BUFFER_SIZE = 512, MAX_LINE_LENGTH = 256 };
+    mutable char rxBuffer[RX_BUFFER_SIZE];
+    mutable unsigned int rxHead, rxTail;
+
+    // Line currently being assembled from rxBuffer.
+    mutable char line[MAX_LINE_LENGTH];
     mutable int lineLen;
     int fd;
 
-    int readLine() const;
+    // Receive time of each chunk still in rxBuffer, by the ring position
+    // its data ends at, so a line is stamped with the chunk that ended it.
+    enum { RX_STAMPS = 8 };
+    struct RxStamp
+    {
+        unsigned int end;
+        double time;
+    };
+    mutable RxStamp rxStamps[RX_STAMPS];
+    mutable unsigned int rxStampHead, rxStampTail;
+
+    // Send time of the query whose reply was read last, and that
+    // reply's receive time.
+    mutable double querySent, queryTime, replyTime;
+
+    // Commands collected between beginBatch() and commitBatch().
+    enum { TX_BUFFER_SIZE = 1024 };
+    mutable char txBuffer[TX_BUFFER_SIZE];
+    mutable int txLen;
+    bool batching;
+
+    // Optional datagram socket for velocity commands, and the sequence
+    // number of the last datagram sent on it.
+    int velocityFd;
+    mutable unsigned int velocitySeq;
+
+    // Optional record of everything sent and received.
+    TrafficLog* trafficLog;
+    unsigned int trafficChannel;
+
+    int readLine( bool block=true) const;
+    int fillBuffer( bool block) const;
+    int writeCommand( const char* cmd, int len) const;
+    int sendCommand( const char* cmd, int len) const;
+    template <class C> int sendCommand( const double* args) const;
+    template <class C> int sendVelocity( const double* args) const;
+    int sendQuery( const char* cmd, int len) const;
+    int sendBuffered( const char* cmd, int len) const;
+
+public:
+    /**
+     * @brief Handler for an asynchronous position query.
+     *
+     * Called with rc 0 and the parsed reply, or with rc -1 and zeroed
+     * values if the connection failed before the reply arrived.
+     * The orientation is in radians.
+     */
+    typedef boost::function<void (int rc, double x, double y,
+        double orientation, int queueSize)> PositionHandler;
+
+    /**
+     * @brief Handler for an asynchronous single-value query.
+     *
+     * Called with rc 0 and the parsed value, or with rc -1 if the
+     * connection failed before the reply arrived.
+     */
+    typedef boost::function<void (int rc, double value)> ValueHandler;
+
+    /**
+     * @brief Handler for the completion of queued turtle commands.
+     *
+     * Called with rc 0 once the commands have been executed, 1 if the
+     * queue was cleared first (by stop() or a velocity command), or -1
+     * if the connection failed.
+     */
+    typedef boost::function<void (int rc)> CompletionHandler;
+
+private:
+    struct PendingReply
+    {
+        enum Kind { POSITION, VALUE } kind;
+        PositionHandler position;
+        ValueHandler value;
+        double sent;
+
+        // Turtle commands queued, and queue clears, before this query
+        // was sent.
+        unsigned long queued, cleared;
+
+        // Position stream generation that re-issues this query once
+        // answered, or 0.
+        unsigned int stream;
+
+        // Turtle limit answered by a VALUE query, or NO_LIMIT.
+        int limit;
+    };
+
+    // Handlers for queries that have been sent but not yet answered,
+    // oldest first.
+    mutable std::deque<PendingReply> pending;
+
+    // Position stream, emulated by keeping queries in flight.
+    PositionHandler streamHandler;
+    unsigned int streamGeneration;
+    bool streaming;
+
+    // Turtle command completion, tracked from the queue length in q
+    // replies: of the motionQueued commands sent before a query, all
+    // but the reported queue length have been executed.  Replies to
+    // queries sent before the latest clear say nothing about the queue.
+    struct Completion
+    {
+        unsigned long id;
+        CompletionHandler handler;
+    };
+    mutable unsigned long motionQueued, motionDone, queryQueued;
+    mutable unsigned long clearCount, queryCleared;
+    mutable int queueLength;
+    mutable std::deque<Completion> completions;
+    double waitInterval;
+
+    // Latest position reply, served by the blocking getters while it is
+    // younger than cacheMaxAge, and the turtle limits as last set or
+    // read, which only change when set.
+    enum Limit { MAX_SPEED, MAX_ACCEL, MAX_CORNERING_ERROR, LIMITS, NO_LIMIT = -1 };
+    mutable double cachedX, cachedY, cachedOrientation;
+    mutable double cachedQueryTime, cachedReplyTime;
+    mutable bool poseCached;
+    mutable double cachedLimits[LIMITS];
+    mutable bool limitCached[LIMITS];
+    double cacheMaxAge;
+
+    bool poseFresh() const;
+    void updatePosition( unsigned long queued, unsigned long cleared,
+        double x, double y, double orientation, int qlen) const;
+    double getLimit( int limit, const char* cmd, int len) const;
+    template <class C> int setLimit( int limit, double value);
+    int queryQueueSize() const;
+
+    template <class C> int queueMotion( const double* args);
+    void updateQueue( unsigned long queued, unsigned long cleared,
+        int qlen) const;
+    void clearQueue() const;
+    void completeMotions( unsigned long done, int rc) const;
+
+    int queueQuery( const char* cmd, int len, const PendingReply& reply) const;
+    int queueStreamQuery() const;
+    int readReply() const;
+    int dispatchReply() const;
+    void failPending() const;
 
 public:
+    /**
+     * @brief Socket tuning for the turtle interface connection.
+     *
+     * The defaults disable Nagle's algorithm, so that short commands
+     * and queries go out immediately, and leave everything else at the
+     * system defaults.
+     */
+    struct SocketOptions
+    {
+        /** Set TCP_NODELAY. */
+        bool noDelay;
+
+        /** Enable TCP keepalive probes, to detect a dead peer. */
+        bool keepAlive;
+
+        /** Idle seconds before the first probe, interval in seconds
+         *  between probes, and unanswered probes before the connection
+         *  is dropped.  Zero leaves the system default. */
+        int keepAliveIdle, keepAliveInterval, keepAliveCount;
+
+        /** Blocking reads and writes fail after this many seconds,
+         *  or never if zero. */
+        double recvTimeout, sendTimeout;
+
+        /** SO_PRIORITY for outgoing packets, or -1 to leave it. */
+        int priority;
+
+        /** IP type of service byte (eg DSCP << 2), or -1 to leave it. */
+        int tos;
+
+        /** Let the kernel timestamp received data (SO_TIMESTAMPNS),
+         *  rather than reading the clock once recvmsg() returns. */
+        bool timestamps;
+
+        /** Send velocity commands as sequence numbered UDP datagrams to
+         *  this port on the same host, or over the TCP connection if 0.
+         *  Only for bases that support it. */
+        int velocityPort;
+
+        SocketOptions()
+            : noDelay(true), keepAlive(false),
+              keepAliveIdle(0), keepAliveInterval(0), keepAliveCount(0),
+              recvTimeout(0.0), sendTimeout(0.0), priority(-1), tos(-1),
+              timestamps(true), velocityPort(0) {}
+    };
+
     /**
      * @brief Create the Nav2Remote object.
      *
@@ -46,8 +259,12 @@ public:
      *
      * @param host The remote hostname or IP address.
      * @param port The TCP port.
+     * @param timeout Give up on each address after this many seconds,
+     * or use the system connect timeout if zero.
+     * @param options Socket options to apply once connected.
      */
-    Nav2Remote( const char* host, int port=5010);
+    Nav2Remote( const char* host, int port=5010, double timeout=0.0,
+        const SocketOptions& options=SocketOptions());
 
     ~Nav2Remote();
 
@@ -111,7 +328,10 @@ public:
      * @param orientation Output parameter for the estimated orientation
      * in radians.
      *
+     * Served from the state cache when it is fresh.
+     *
      * @return 0 on success, non-zero on IO error.
+     * @see setCacheMaxAge
      */
     int estimatePosition( double& x, double& y, double& orientation) const;
 
@@ -131,6 +351,10 @@ public:
     /**
      * @brief Stop the robot immediately.
      *
+     * With a velocity channel, a zero velocity datagram goes out along
+     * with the stop, so that the base drops any velocity datagram sent
+     * earlier that is still in flight.
+     *
      * @return 0 on success, non-zero on IO error.
      */
     int stop();
@@ -232,7 +456,7 @@ public:
      * @brief Get the maximum speed for turtle commands.
      *
      * @return The maximum speed in meters per second, or -1 on IO error.
-     * @see setMaxSpeed
+     * @see setMaxSpeed, setCacheMaxAge
      */
     double getMaxSpeed() const;
 
@@ -241,7 +465,7 @@ public:
      *
      * @return The maximum acceleration in meters per second squared,
      * or -1 on IO error.
-     * @see setMaxAccel
+     * @see setMaxAccel, setCacheMaxAge
      */
     double getMaxAccel() const;
 
@@ -249,7 +473,7 @@ public:
      * @brief Get the maximum cornering error for turtle commands.
      *
      * @return The maximum cornering error in meters, or -1 on IO error.
-     * @see setMaxCorneringError
+     * @see setMaxCorneringError, setCacheMaxAge
      */
     double getMaxCorneringError() const;
 
@@ -257,17 +481,311 @@ public:
      * @brief Get the turtle command queue size.
      *
      * Get the number of turtle line segments remaining in the queue.
+     * Served from the state cache when it is fresh, counting commands
+     * queued since as remaining.
      * @return The number of segments, or -1 on IO error.
-     * @see wait
+     * @see wait, setCacheMaxAge
      */
     int getQueueSize() const;
 
+    /**
+     * @brief Serve blocking getters from recent replies.
+     *
+     * Every position reply, whichever call asked for it, updates the
+     * cached position and queue size together, and estimatePosition()
+     * and getQueueSize() return them without a round trip while they
+     * are younger than maxAge.  The turtle limits are cached as they
+     * are set or read, and then served without a query at all, since
+     * they only change when set.  getQueryTime() and getReplyTime()
+     * refer to the cached reply when it is served.
+     *
+     * @param maxAge Age in seconds up to which cached replies are
+     * served, or 0 to always query the robot, the default.
+     */
+    void setCacheMaxAge( double maxAge) { cacheMaxAge = maxAge; }
+
+    /**
+     * @brief Get the age up to which cached replies are served.
+     * @see setCacheMaxAge
+     */
+    double getCacheMaxAge() const { return cacheMaxAge; }
+
     /**
      * @brief Wait until the turtle command queue is empty.
+     *
+     * While a position stream is running its replies are used, so no
+     * extra queries are sent.  Otherwise the queue is queried at most
+     * once per wait interval, and the wait ends on the first reply that
+     * shows an empty queue.  Commands collected in a batch are sent
+     * first, the batch itself stays open.
+     *
      * @return 0 on success, or -1 on IO error.
-     * @see getQueueSize
+     * @see getQueueSize, setWaitInterval, whenIdle
      */
     int wait() const;
+
+    /**
+     * @brief Set the shortest time between the queries sent by wait().
+     *
+     * @param interval The interval in seconds, 0.02 by default.
+     */
+    void setWaitInterval( double interval) { waitInterval = interval; }
+
+    /**
+     * @brief Move, and call a handler once the move has completed.
+     *
+     * @param dist The distance in meters.
+     * @param direction The relative direction of travel in radians.
+     * @param done Called as for whenIdle(), for this move.
+     * @return 0 on success, non-zero on IO error.
+     * @see move, whenIdle
+     */
+    int move( double dist, double direction, const CompletionHandler& done);
+
+    /**
+     * @brief Turn left, and call a handler once the turn has completed.
+     *
+     * @param angle The angle in radians.
+     * @param done Called as for whenIdle(), for this turn.
+     * @return 0 on success, non-zero on IO error.
+     * @see turnLeft, whenIdle
+     */
+    int turnLeft( double angle, const CompletionHandler& done);
+
+    /**
+     * @brief Call a handler once every turtle command queued so far has
+     * completed.
+     *
+     * Completion is detected from the queue length in the replies to
+     * position queries, whichever call sent them, so nothing is sent
+     * here: some other code must keep querying, eg an odometry poll, a
+     * position stream or wait().  Handlers run from inside the call that
+     * read the reply.  If nothing is queued, the handler is called
+     * immediately with rc 0.
+     *
+     * @param handler Called with rc 0 on completion, 1 if the queue was
+     * cleared first, or -1 on IO error.
+     * @see getCompletedMotions
+     */
+    void whenIdle( const CompletionHandler& handler) const;
+
+    /**
+     * @brief Get the number of turtle commands queued since connecting.
+     */
+    unsigned long getQueuedMotions() const { return motionQueued; }
+
+    /**
+     * @brief Get the number of queued turtle commands known to have
+     * completed or been cleared.
+     */
+    unsigned long getCompletedMotions() const { return motionDone; }
+
+    /**
+     * @brief Estimate the position without blocking for the reply.
+     *
+     * Sends a position query and queues the handler, which is called
+     * once the matching reply has been read.
+     *
+     * @param handler Called with the estimated position and queue size.
+     * @return 0 on success, non-zero on IO error.
+     * @see estimatePosition, processReplies
+     */
+    int estimatePositionAsync( const PositionHandler& handler) const;
+
+    /**
+     * @brief Get the maximum speed without blocking for the reply.
+     *
+     * @param handler Called with the maximum speed in meters per second.
+     * @return 0 on success, non-zero on IO error.
+     * @see getMaxSpeed, processReplies
+     */
+    int getMaxSpeedAsync( const ValueHandler& handler) const;
+
+    /**
+     * @brief Get the maximum acceleration without blocking for the reply.
+     *
+     * @param handler Called with the maximum acceleration in meters per
+     * second squared.
+     * @return 0 on success, non-zero on IO error.
+     * @see getMaxAccel, processReplies
+     */
+    int getMaxAccelAsync( const ValueHandler& handler) const;
+
+    /**
+     * @brief Get the maximum cornering error without blocking for the reply.
+     *
+     * @param handler Called with the maximum cornering error in meters.
+     * @return 0 on success, non-zero on IO error.
+     * @see getMaxCorneringError, processReplies
+     */
+    int getMaxCorneringErrorAsync( const ValueHandler& handler) const;
+
+    /**
+     * @brief Receive positions continuously.
+     *
+     * The turtle interface has no streaming command, so this keeps
+     * depth position queries in flight, sending the next one as soon as
+     * a reply is dispatched.  The link then carries one query per round
+     * trip and the handler gets a sample at the same rate, without
+     * anyone waiting on the network.  Replies are dispatched by
+     * processReplies(), flush() or any blocking query, as for
+     * estimatePositionAsync().  Restarting a stream replaces the
+     * handler and depth.
+     *
+     * @param handler Called with each position and queue size.
+     * @param depth Number of queries to keep in flight.
+     * @return 0 on success, non-zero on IO error.
+     * @see stopPositionStream
+     */
+    int startPositionStream( const PositionHandler& handler, int depth=1);
+
+    /**
+     * @brief Stop re-issuing stream queries.
+     *
+     * Queries already in flight are still answered and dispatched.
+     */
+    void stopPositionStream() { streaming = false; }
+
+    /**
+     * @brief Check whether a position stream is running.
+     */
+    bool isStreaming() const { return streaming; }
+
+    /**
+     * @brief Dispatch any replies that have already arrived.
+     *
+     * Reads whatever the socket has ready without blocking, and calls the
+     * handler of every complete reply.  Lines that answer no query are
+     * discarded, so the socket is drained even with nothing pending.  On
+     * IO error, or once the base has closed the connection, all pending
+     * handlers are called with rc -1.
+     *
+     * @return The number of handlers called, or -1 on IO error or end of
+     * file.
+     * @see flush
+     */
+    int processReplies() const;
+
+    /**
+     * @brief Block until every pending asynchronous query is answered.
+     *
+     * Commands and queries collected in a batch are sent first, the
+     * batch itself stays open.  Queries sent by handlers while flushing
+     * are not waited for.
+     *
+     * @return 0 on success, or -1 on IO error.
+     * @see processReplies
+     */
+    int flush() const;
+
+    /**
+     * @brief Get the number of asynchronous queries awaiting a reply.
+     */
+    int getPendingReplies() const { return pending.size(); }
+
+    /**
+     * @brief Get the time the query answered by the latest reply was sent.
+     *
+     * Valid after a blocking query returns, and inside reply handlers.
+     * Queries collected in a batch count as sent when the batch is.
+     *
+     * @return Seconds since the epoch, on the system realtime clock.
+     * @see getReplyTime
+     */
+    double getQueryTime() const { return queryTime; }
+
+    /**
+     * @brief Get the time the latest reply was received.
+     *
+     * Taken from the kernel receive timestamp where available, so it
+     * does not include the time the reply waited to be read.  Valid
+     * after a blocking query returns, and inside reply handlers.
+     *
+     * @return Seconds since the epoch, on the system realtime clock.
+     * @see getQueryTime
+     */
+    double getReplyTime() const { return replyTime; }
+
+    /**
+     * @brief Start collecting commands instead of sending them.
+     *
+     * Until commitBatch(), commands and asynchronous queries are
+     * buffered and return 0; IO errors are reported by commitBatch().
+     * Blocking queries send everything collected so far together with
+     * the query, and batching continues afterwards.  If the buffer
+     * fills up, the collected commands are sent early.
+     *
+     * @see commitBatch
+     */
+    void beginBatch() { batching = true; }
+
+    /**
+     * @brief Send the collected commands with one system call.
+     *
+     * Does nothing if no batch is open.  On IO error, the handlers of
+     * all pending queries are called with rc -1.
+     *
+     * @return 0 on success, or -1 on IO error.
+     * @see beginBatch
+     */
+    int commitBatch();
+
+    /**
+     * @brief Check whether commands are being collected.
+     */
+    bool isBatching() const { return batching; }
+
+    /**
+     * @brief Change the options of the open connection.
+     *
+     * Every option is applied even if an earlier one fails.
+     *
+     * @param options The options to apply.
+     * @return 0 on success, or -1 if any option could not be set.
+     */
+    int setSocketOptions( const SocketOptions& options);
+
+    /**
+     * @brief Record the traffic of this connection.
+     *
+     * Every command and query written and every complete line received,
+     * including the ignored | and + lines, is pushed to the log.  The
+     * log must outlive this object or be replaced first, and all
+     * connections sharing it must be used from the same thread.
+     *
+     * @param log The log, or NULL to stop recording.
+     * @param channel Channel number to tag the records with.
+     */
+    void setTrafficLog( TrafficLog* log, unsigned int channel=0)
+    {
+        trafficLog = log;
+        trafficChannel = channel;
+    }
+
+    /**
+     * @brief Get the socket descriptor, eg for use with poll().
+     *
+     * The descriptor becomes readable when processReplies() has
+     * something to do.  Do not read from or write to it directly.
+     */
+    int getFd() const { return fd; }
+
+    /**
+     * @brief Check whether velocity commands go out as datagrams.
+     *
+     * Datagrams are sent right away, even while batching, and are not
+     * ordered with the commands sent over TCP.  Lost or stale ones are
+     * simply superseded by the next velocity command, and stop() sends
+     * one too, so that no earlier datagram can restart the base.
+     *
+     * @see SocketOptions::velocityPort
+     */
+    bool hasVelocityChannel() const { return velocityFd >= 0; }
+
+    /**
+     * @brief Get the sequence number of the last velocity datagram.
+     */
+    unsigned int getVelocitySequence() const { return velocitySeq; }
 };
 
 #endif
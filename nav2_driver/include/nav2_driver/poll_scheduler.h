@@ -0,0 +1,109 @@
+#ifndef NAV2_DRIVER_POLL_SCHEDULER_H
+#define NAV2_DRIVER_POLL_SCHEDULER_H
+
+#include <algorithm>
+
+namespace nav2_driver{
+
+/**
+ * @brief Schedules odometry polls at a fixed rate, or adaptively as fast as the measured round trip time allows.
+ *
+ * Times are in seconds on any monotonic-enough clock. A poll that finishes after the next one was due counts as an
+ * overrun; the next poll then starts immediately instead of trying to catch up on the missed ones.
+ */
+class PollScheduler{
+
+public:
+
+    /**
+     * @param rate Poll rate in Hz, also the slowest adaptive rate
+     * @param max_rate Fastest adaptive poll rate in Hz
+     * @param adaptive Follow the measured round trip time between rate and max_rate
+     */
+    explicit PollScheduler(double rate = 10.0, double max_rate = 10.0, bool adaptive = false) :
+        min_period_(1.0 / std::max(rate, max_rate)),
+        max_period_(1.0 / rate),
+        adaptive_(adaptive),
+        rtt_(0.0),
+        overruns_(0)
+    {}
+
+    /**
+     * @brief Change the rates, keeping the measured round trip time and overrun count
+     * @param rate Poll rate in Hz, also the slowest adaptive rate
+     * @param max_rate Fastest adaptive poll rate in Hz
+     * @param adaptive Follow the measured round trip time between rate and max_rate
+     */
+    void setRates(double rate, double max_rate, bool adaptive){
+        min_period_ = 1.0 / std::max(rate, max_rate);
+        max_period_ = 1.0 / rate;
+        adaptive_ = adaptive;
+    }
+
+    /**
+     * @brief Record the round trip time of a completed poll
+     * @param rtt Time between sending the query and receiving the reply
+     */
+    void addRoundTrip(double rtt){
+        //smooth out single slow replies
+        const double gain = 0.1;
+        rtt_ = rtt_ > 0.0 ? rtt_ + gain * (rtt - rtt_) : rtt;
+    }
+
+    /**
+     * @brief Get the current poll period
+     */
+    double getPeriod() const{
+        if(!adaptive_){
+            return max_period_;
+        }
+        //leave some of the link for velocity commands
+        const double headroom = 1.25;
+        return std::min(max_period_, std::max(min_period_, rtt_ * headroom));
+    }
+
+    /**
+     * @brief Get the shortest period this scheduler will ever use
+     */
+    double getMinPeriod() const{
+        return adaptive_ ? min_period_ : max_period_;
+    }
+
+    /**
+     * @brief Compute when the next poll should start
+     * @param last_start Start time of the poll that just completed, or the time a poll that was just sent was due at,
+     * so that an event loop waking up late counts as an overrun
+     * @param now Current time
+     * @return Start time of the next poll, never earlier than now
+     */
+    double next(double last_start, double now){
+        double due = last_start + getPeriod();
+        if(due < now){
+            ++overruns_;
+            due = now;
+        }
+        return due;
+    }
+
+    /**
+     * @brief Get the smoothed round trip time, 0 until the first poll completes
+     */
+    double getRoundTrip() const { return rtt_; }
+
+    /**
+     * @brief Get the number of polls that overran their period so far
+     */
+    unsigned long getOverruns() const { return overruns_; }
+
+private:
+
+    double min_period_, max_period_;
+    bool adaptive_;
+    double rtt_;
+    unsigned long overruns_;
+
+};
+
+}
+
+#endif
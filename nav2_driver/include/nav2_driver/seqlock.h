@@ -0,0 +1,74 @@
+#ifndef NAV2_DRIVER_SEQLOCK_H
+#define NAV2_DRIVER_SEQLOCK_H
+
+#include <boost/atomic.hpp>
+
+namespace nav2_driver{
+
+/**
+ * @brief Lock-free single-writer, multiple-reader snapshot of a small value.
+ *
+ * A sequence counter is odd while a write is in progress; readers copy the value and retry if the counter was odd or
+ * changed meanwhile. Writing never waits, and any number of threads may read concurrently without modifying shared
+ * state, unlike LatestValue which hands each value to one consumer. T should be a small trivially copyable type, since
+ * readers may copy a torn value before discarding it.
+ */
+template <typename T>
+class SeqLock{
+
+public:
+
+    SeqLock() : sequence_(0), value_() {}
+
+    /**
+     * @brief Replace the value. Writer thread only.
+     */
+    void write(const T& value){
+        unsigned int sequence = sequence_.load(boost::memory_order_relaxed);
+        sequence_.store(sequence + 1, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        value_ = value;
+        sequence_.store(sequence + 2, boost::memory_order_release);
+    }
+
+    /**
+     * @brief Try once to get a consistent copy of the latest value, eg when the writer may have died mid-write
+     * @param value Output for the value, may be torn if false is returned
+     * @return true if the copy is consistent
+     */
+    bool tryRead(T& value) const{
+        unsigned int before = sequence_.load(boost::memory_order_acquire);
+        value = value_;
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        return !(before & 1) && before == sequence_.load(boost::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get a consistent copy of the latest value, from any thread
+     */
+    T read() const{
+        T value;
+        unsigned int before, after;
+        do{
+            before = sequence_.load(boost::memory_order_acquire);
+            value = value_;
+            boost::atomic_thread_fence(boost::memory_order_acquire);
+            after = sequence_.load(boost::memory_order_relaxed);
+        }while((before & 1) || before != after);
+        return value;
+    }
+
+private:
+
+    // No copying allowed
+    SeqLock(const SeqLock&);
+    SeqLock& operator=(const SeqLock&);
+
+    boost::atomic<unsigned int> sequence_;
+    T value_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef NAV2_DRIVER_SHM_ODOMETRY_H
+#define NAV2_DRIVER_SHM_ODOMETRY_H
+
+#include <nav2_driver/seqlock.h>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace nav2_driver{
+
+/**
+ * @brief One odometry sample as published by nav2_driver, in the odom frame with the twist in the base frame
+ */
+struct ShmOdometrySample{
+    uint64_t index;    //number of samples written before this one
+    int64_t stamp;     //ROS time in nanoseconds
+    double x, y, th;
+    double vx, vy, wz;
+};
+
+/**
+ * @brief Layout of the shared memory segment: a header, followed by a ring of samples, each behind its own sequence
+ * lock so that readers never block the driver, and only ever load from the mapping.
+ */
+struct ShmOdometryLayout{
+
+    static const uint32_t VERSION = 1;
+
+    //slots start on their own cache lines, so that reading one never contends with writing the next
+    static const size_t ALIGNMENT = 64;
+
+    struct Header{
+        char magic[8];
+        uint32_t version;
+        uint32_t capacity;
+        boost::atomic<uint64_t> count;     //samples written so far
+        boost::atomic<uint32_t> closed;    //set once the driver has removed the segment
+    };
+
+    typedef SeqLock<ShmOdometrySample> Slot;
+
+    static size_t headerSize() { return (sizeof(Header) + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+    static size_t slotSize() { return (sizeof(Slot) + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+    static size_t size(uint32_t capacity) { return headerSize() + capacity * slotSize(); }
+
+};
+
+//the magic lives in a template so that the header needs no translation unit of its own
+template <typename Dummy>
+struct ShmOdometryMagic{
+    static const char value[8];
+};
+template <typename Dummy>
+const char ShmOdometryMagic<Dummy>::value[8] = { 'N', 'A', 'V', '2', 'O', 'D', 'O', 'M' };
+
+/**
+ * @brief Writes odometry samples into a POSIX shared memory segment, which is removed again on destruction.
+ * Single writer only.
+ */
+class ShmOdometryWriter{
+
+public:
+
+    /**
+     * @param name Segment name, as for shm_open, eg "/nav2_odom"
+     * @param capacity Number of samples kept for readers that fall behind
+     * @throw std::runtime_error if the segment cannot be created
+     */
+    ShmOdometryWriter(const std::string& name, uint32_t capacity) :
+        name_(name),
+        capacity_(capacity > 0 ? capacity : 1),
+        size_(ShmOdometryLayout::size(capacity_)),
+        map_(NULL),
+        header_(NULL),
+        count_(0)
+    {
+
+        //replace any segment left behind by a driver that did not shut down cleanly
+        shm_unlink(name_.c_str());
+        int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if(fd < 0){
+            throw std::runtime_error("Can't create odometry shared memory " + name_);
+        }
+        if(ftruncate(fd, size_) < 0){
+            close(fd);
+            shm_unlink(name_.c_str());
+            throw std::runtime_error("Can't size odometry shared memory " + name_);
+        }
+        void* map = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(map == MAP_FAILED){
+            shm_unlink(name_.c_str());
+            throw std::runtime_error("Can't map odometry shared memory " + name_);
+        }
+        map_ = static_cast<char*>(map);
+
+        //slots first, so a reader that maps the segment early sees no samples until the header is complete
+        for(uint32_t i = 0; i < capacity_; ++i){
+            new (map_ + ShmOdometryLayout::headerSize() + i * ShmOdometryLayout::slotSize()) ShmOdometryLayout::Slot();
+        }
+        header_ = new (map_) ShmOdometryLayout::Header();
+        header_->version = ShmOdometryLayout::VERSION;
+        header_->capacity = capacity_;
+        header_->count.store(0, boost::memory_order_relaxed);
+        header_->closed.store(0, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        memcpy(header_->magic, ShmOdometryMagic<void>::value, sizeof(header_->magic));
+
+    }
+
+    ~ShmOdometryWriter(){
+        header_->closed.store(1, boost::memory_order_release);
+        munmap(map_, size_);
+        shm_unlink(name_.c_str());
+    }
+
+    /**
+     * @brief Append a sample, overwriting the oldest one once the ring is full. Never blocks.
+     * @param sample Sample to write, its index is filled in
+     */
+    void write(ShmOdometrySample sample){
+        sample.index = count_;
+        slot(count_ % capacity_).write(sample);
+        header_->count.store(++count_, boost::memory_order_release);
+    }
+
+    /**
+     * @brief Get the number of samples written so far
+     */
+    uint64_t getCount() const { return count_; }
+
+private:
+
+    // No copying allowed
+    ShmOdometryWriter(const ShmOdometryWriter&);
+    ShmOdometryWriter& operator=(const ShmOdometryWriter&);
+
+    ShmOdometryLayout::Slot& slot(uint64_t i){
+        return *reinterpret_cast<ShmOdometryLayout::Slot*>(map_ + ShmOdometryLayout::headerSize() +
+                                                           i * ShmOdometryLayout::slotSize());
+    }
+
+    std::string name_;
+    uint32_t capacity_;
+    size_t size_;
+    char* map_;
+    ShmOdometryLayout::Header* header_;
+    uint64_t count_;
+
+};
+
+/**
+ * @brief Client for the odometry samples nav2_driver writes with the odom_shm parameter, for consumers on the same
+ * host. Reading maps the segment read-only and makes no system calls, so it costs a few cache misses rather than a
+ * message deserialization. Any number of readers, in any number of processes, may read concurrently.
+ *
+ * Link with -lrt for shm_open on older C libraries.
+ *
+ * @code
+ * nav2_driver::ShmOdometryReader odom("/nav2_odom");
+ * nav2_driver::ShmOdometrySample sample;
+ * if(odom.latest(sample)){ ... }
+ * @endcode
+ */
+class ShmOdometryReader{
+
+public:
+
+    /**
+     * @param name Segment name, as given to the driver
+     * @throw std::runtime_error if there is no valid segment of this name
+     */
+    explicit ShmOdometryReader(const std::string& name) :
+        map_(NULL),
+        size_(0),
+        header_(NULL)
+    {
+
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if(fd < 0){
+            throw std::runtime_error("Can't open odometry shared memory " + name);
+        }
+        struct stat st;
+        if(fstat(fd, &st) < 0 || (size_t)st.st_size < ShmOdometryLayout::headerSize()){
+            close(fd);
+            throw std::runtime_error("Not odometry shared memory " + name);
+        }
+        size_ = st.st_size;
+        void* map = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(map == MAP_FAILED){
+            throw std::runtime_error("Can't map odometry shared memory " + name);
+        }
+        map_ = static_cast<const char*>(map);
+        header_ = reinterpret_cast<const ShmOdometryLayout::Header*>(map_);
+
+        //the writer stores the magic last, the rest of the header is only safe to read once it is seen
+        bool valid = memcmp(header_->magic, ShmOdometryMagic<void>::value, sizeof(header_->magic)) == 0;
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        if(!valid || header_->version != ShmOdometryLayout::VERSION ||
+           size_ < ShmOdometryLayout::size(header_->capacity)){
+            munmap(const_cast<char*>(map_), size_);
+            throw std::runtime_error("Not odometry shared memory " + name);
+        }
+
+    }
+
+    ~ShmOdometryReader(){
+        munmap(const_cast<char*>(map_), size_);
+    }
+
+    /**
+     * @brief Get the most recent sample
+     * @param sample Output for the sample, untouched if false is returned
+     * @return false if no sample was written yet, or the writer keeps overwriting it
+     */
+    bool latest(ShmOdometrySample& sample) const{
+        for(int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt){
+            uint64_t count = getCount();
+            if(count == 0){
+                return false;
+            }
+            if(read(count - 1, sample)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Get a sample by index, eg to catch up on every sample since the last one read
+     * @param index Sample index, from 0 to getCount() - 1
+     * @param sample Output for the sample, may be modified even if false is returned
+     * @return false if the sample was not written yet, or was already overwritten
+     */
+    bool read(uint64_t index, ShmOdometrySample& sample) const{
+        if(index >= getCount()){
+            return false;
+        }
+        const ShmOdometryLayout::Slot& slot = *reinterpret_cast<const ShmOdometryLayout::Slot*>(
+            map_ + ShmOdometryLayout::headerSize() + (index % header_->capacity) * ShmOdometryLayout::slotSize());
+        return slot.tryRead(sample) && sample.index == index;
+    }
+
+    /**
+     * @brief Get the number of samples written so far
+     */
+    uint64_t getCount() const { return header_->count.load(boost::memory_order_acquire); }
+
+    /**
+     * @brief Get the number of samples kept in the ring
+     */
+    uint32_t getCapacity() const { return header_->capacity; }
+
+    /**
+     * @brief Check whether the driver removed the segment, after which a restarted driver writes to a new one
+     */
+    bool isClosed() const { return header_->closed.load(boost::memory_order_acquire) != 0; }
+
+private:
+
+    // a slot being rewritten on every attempt means the reader is badly starved anyway
+    static const int MAX_ATTEMPTS = 16;
+
+    // No copying allowed
+    ShmOdometryReader(const ShmOdometryReader&);
+    ShmOdometryReader& operator=(const ShmOdometryReader&);
+
+    const char* map_;
+    size_t size_;
+    const ShmOdometryLayout::Header* header_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef _TRAFFIC_LOG_H_
+#define _TRAFFIC_LOG_H_
+
+#include <string>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * @brief
+ * Binary log of the raw turtle protocol traffic of one or more
+ * connections.
+ *
+ * The file starts with a FileHeader, followed by records that are each
+ * a RecordHeader and the logged bytes, padded to a multiple of eight.
+ * Records are only ever appended, so a log cut short by a crash is
+ * still readable up to its last complete record.  All values are in
+ * host byte order.
+ *
+ * push() only copies the record into a lock-free ring buffer; a
+ * background thread writes the ring to the file, either with write()
+ * or by copying into a memory mapped window of the file.  If the
+ * writer falls behind and the ring is full, records are dropped and
+ * counted rather than blocking the caller.
+ *
+ * Only one thread may push at a time, eg the thread owning the
+ * connections being logged.
+ */
+class TrafficLog
+{
+    // No copying allowed
+    TrafficLog(const TrafficLog&);
+    TrafficLog& operator=(const TrafficLog&);
+
+public:
+    enum Direction { SENT = 0, RECEIVED = 1 };
+
+    enum { VERSION = 1 };
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+
+        // CLOCK_REALTIME minus CLOCK_MONOTONIC when the log was opened,
+        // in nanoseconds.
+        int64_t realtimeOffset;
+    };
+
+    struct RecordHeader
+    {
+        // CLOCK_MONOTONIC time of the push, in nanoseconds.
+        uint64_t time;
+        uint32_t length;
+        uint16_t channel;
+        uint8_t direction;
+        uint8_t reserved;
+    };
+
+    static const char MAGIC[8];
+
+    /**
+     * @brief Create or truncate a log file and start its writer thread.
+     *
+     * Throws std::runtime_error if the file cannot be created.
+     *
+     * @param path The file to write.
+     * @param bufferSize Ring buffer size in bytes, rounded up to a power
+     * of two.
+     * @param mapped Write through a memory mapping instead of write().
+     */
+    TrafficLog( const std::string& path, size_t bufferSize=1 << 20,
+        bool mapped=false);
+
+    /**
+     * @brief Write all pushed records and close the file.
+     */
+    ~TrafficLog();
+
+    /**
+     * @brief Append a record, without blocking on IO.
+     *
+     * @param direction SENT or RECEIVED.
+     * @param data The bytes that crossed the connection.
+     * @param len The number of bytes, at most about half the ring size.
+     * @param channel Connection number, eg of a robot in a fleet.
+     * @return true if the record was queued, or false if it was dropped
+     * because the ring is full.
+     */
+    bool push( int direction, const char* data, size_t len,
+        unsigned int channel=0);
+
+    /**
+     * @brief Get the number of records dropped because the ring was full.
+     */
+    unsigned long getDropped() const { return dropped; }
+
+    /**
+     * @brief Get the number of bytes written to the file so far.
+     */
+    unsigned long getWritten() const { return written; }
+
+    /**
+     * @brief Get the current CLOCK_MONOTONIC time in nanoseconds, as
+     * used for record times.
+     */
+    static uint64_t monotonicTime();
+
+private:
+    char* ring;
+    size_t ringSize;
+
+    // Free running byte positions, masked on access.  head is advanced
+    // by the writer thread only, tail by push() only.
+    boost::atomic<size_t> head, tail;
+
+    int fd;
+    bool mapped;
+    char* map;
+    size_t mapOffset, mapUsed;
+
+    boost::atomic<unsigned long> dropped, written;
+    boost::atomic<bool> running;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    boost::thread writer;
+
+    void writerLoop();
+    int drain();
+    int output( const char* data, size_t len);
+    int remap();
+};
+
+/**
+ * @brief
+ * Sequential reader for the files written by TrafficLog.
+ *
+ * The file is memory mapped, and record data points into the mapping,
+ * so it stays valid for as long as the reader exists.
+ */
+class TrafficLogReader
+{
+    // No copying allowed
+    TrafficLogReader(const TrafficLogReader&);
+    TrafficLogReader& operator=(const TrafficLogReader&);
+
+public:
+    struct Record
+    {
+        // CLOCK_MONOTONIC time of the record, in nanoseconds.
+        uint64_t time;
+        unsigned int channel;
+        int direction;
+        const char* data;
+        size_t length;
+    };
+
+    /**
+     * @brief Open a log file.
+     *
+     * Throws std::runtime_error if the file cannot be read or is not a
+     * traffic log.
+     *
+     * @param path The file to read.
+     */
+    explicit TrafficLogReader( const std::string& path);
+
+    ~TrafficLogReader();
+
+    /**
+     * @brief Read the next record.
+     *
+     * @param record Output parameter for the record.
+     * @return true if a record was read, or false at the end of the log
+     * or at a truncated record.
+     */
+    bool next( Record& record);
+
+    /**
+     * @brief Start reading from the first record again.
+     */
+    void rewind();
+
+    /**
+     * @brief Get CLOCK_REALTIME minus CLOCK_MONOTONIC when the log was
+     * written, in nanoseconds.
+     */
+    int64_t getRealtimeOffset() const { return header.realtimeOffset; }
+
+private:
+    const char* data;
+    size_t size, offset;
+    TrafficLog::FileHeader header;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef NAV2_DRIVER_TRANSFORM_CACHE_H
+#define NAV2_DRIVER_TRANSFORM_CACHE_H
+
+#include <ros/ros.h>
+#include <geometry_msgs/TransformStamped.h>
+
+#include <nav2_driver/base_odometry.h>
+
+#include <cmath>
+
+namespace nav2_driver{
+
+/**
+ * @brief Keeps the odometry transform for the latest published pose, and decides when it needs publishing.
+ *
+ * Rotation and inverse are only recomputed when the pose changes, in closed form for a planar pose. With skipping
+ * enabled, an unchanged pose is only republished once keepalive seconds of sample time have passed, so that tf
+ * listeners still see a recent transform while the robot is stationary.
+ */
+class TransformCache{
+
+public:
+
+    /**
+     * @param skip_unchanged Skip publishing samples whose pose equals the one last published
+     * @param keepalive Republish an unchanged pose anyway once the last publish is this many seconds older
+     */
+    explicit TransformCache(bool skip_unchanged = false, double keepalive = 0.0) :
+        skip_unchanged_(skip_unchanged),
+        keepalive_(keepalive),
+        valid_(false),
+        invert_(false),
+        skipped_(0)
+    {}
+
+    /**
+     * @brief Get the transform, eg to set its frame ids, which are left untouched otherwise
+     */
+    geometry_msgs::TransformStamped& getTransform() { return transform_; }
+
+    /**
+     * @brief Update the transform from an odometry sample
+     * @param odom Odometry state
+     * @param invert_odom Invert odometry for use with robot_pose_ekf
+     * @return true if the transform should be published
+     */
+    bool update(const BaseOdometry& odom, bool invert_odom){
+
+        Pose2D pose = odom.getOffsetPose();
+        ros::Time stamp = odom.getStamp();
+        bool changed = !valid_ || invert_odom != invert_ || pose.x != pose_.x || pose.y != pose_.y ||
+                       pose.th != pose_.th;
+
+        if(changed){
+            fill(pose, invert_odom);
+        }else if(skip_unchanged_ && stamp < transform_.header.stamp + ros::Duration(keepalive_)){
+            ++skipped_;
+            return false;
+        }
+
+        transform_.header.stamp = stamp;
+        return true;
+
+    }
+
+    /**
+     * @brief Copy the transform into an outgoing message, eg one recycled from a MessagePool. Frame ids are only
+     * assigned when they differ, so refilling a message that held this transform before allocates nothing.
+     * @param message Transform to fill
+     */
+    void copyTo(geometry_msgs::TransformStamped& message) const{
+        if(message.header.frame_id != transform_.header.frame_id){
+            message.header.frame_id = transform_.header.frame_id;
+        }
+        if(message.child_frame_id != transform_.child_frame_id){
+            message.child_frame_id = transform_.child_frame_id;
+        }
+        message.header.stamp = transform_.header.stamp;
+        message.transform = transform_.transform;
+    }
+
+    /**
+     * @brief Get the number of samples not published because the pose was unchanged
+     */
+    unsigned long getSkipped() const { return skipped_; }
+
+private:
+
+    void fill(const Pose2D& pose, bool invert_odom){
+
+        valid_ = true;
+        invert_ = invert_odom;
+        pose_ = pose;
+
+        //yaw only rotation, the inverse rotates by -th and moves by -R(-th)*t
+        double c = std::cos(pose.th), s = std::sin(pose.th);
+        double x = pose.x, y = pose.y, half = 0.5 * pose.th;
+        if(invert_odom){
+            x = -(c * pose.x + s * pose.y);
+            y = s * pose.x - c * pose.y;
+            half = -half;
+        }
+
+        transform_.transform.translation.x = x;
+        transform_.transform.translation.y = y;
+        transform_.transform.translation.z = 0.0;
+        transform_.transform.rotation.x = 0.0;
+        transform_.transform.rotation.y = 0.0;
+        transform_.transform.rotation.z = std::sin(half);
+        transform_.transform.rotation.w = std::cos(half);
+
+    }
+
+    bool skip_unchanged_;
+    double keepalive_;
+    geometry_msgs::TransformStamped transform_;
+    bool valid_, invert_;
+    Pose2D pose_;
+    unsigned long skipped_;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef NAV2_DRIVER_VELOCITY_COMMAND_H
+#define NAV2_DRIVER_VELOCITY_COMMAND_H
+
+#include <nav2_driver/nav2protocol.h>
+#include <nav2_driver/nav2remote.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace nav2_driver{
+
+/**
+ * @brief Velocity goal as received from ROS, converted to base controller units when sent
+ */
+struct VelocityCommand{
+
+    VelocityCommand() : vx(0), vy(0), wz(0) {}
+    double vx, vy, wz;
+
+    /**
+     * @brief Largest component difference, for CommandCoalescer
+     */
+    double distance(const VelocityCommand& other) const{
+        return std::max(std::fabs(vx - other.vx), std::max(std::fabs(vy - other.vy), std::fabs(wz - other.wz)));
+    }
+
+    /**
+     * @brief Check that the command can be sent, ie every component is finite and within what the protocol can carry
+     */
+    bool isValid() const{
+        return nav2protocol::canFormat(sqrt(pow(vx,2) + pow(vy,2))) &&
+               nav2protocol::canFormat(nav2protocol::RadiansToDegrees::convert(wz));
+    }
+
+    /**
+     * @brief Send to the base controller
+     * @return 0 on success, non-zero on IO error
+     */
+    int send(Nav2Remote& remote) const{
+        //convert from vector velocity to relative angular velocity
+        double vs = sqrt(pow(vx,2) + pow(vy,2));
+        double vn = atan2(vy,vx) * (180 / M_PI);
+        return remote.setRelativeVelocity(vn, vs, wz);
+    }
+
+};
+
+}
+
+#endif
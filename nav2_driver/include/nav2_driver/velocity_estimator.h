@@ -0,0 +1,261 @@
+#ifndef NAV2_DRIVER_VELOCITY_ESTIMATOR_H
+#define NAV2_DRIVER_VELOCITY_ESTIMATOR_H
+
+#include <algorithm>
+#include <string>
+
+namespace nav2_driver{
+
+/**
+ * @brief Estimates velocity from timestamped position samples, in constant time per sample and without allocating.
+ *
+ * DIFFERENCE divides the change between the last two samples by their time difference, as odometry always did.
+ * LEAST_SQUARES fits a line to the last window samples through running sums over a ring buffer. ALPHA_BETA tracks
+ * position and velocity with fixed gains. Samples that are not newer than the previous one leave the estimate
+ * unchanged, so a repeated or out of order stamp never divides by zero. LEAST_SQUARES also measures the variance of
+ * its estimate, from the scatter of the window around the fitted line.
+ *
+ * Positions must be continuous, ie angles unwrapped, as the odometry pose is.
+ */
+class VelocityEstimator{
+
+public:
+
+    enum { AXES = 3, MAX_WINDOW = 16 };
+
+    enum Method { DIFFERENCE, LEAST_SQUARES, ALPHA_BETA };
+
+    /**
+     * @param method Estimation method
+     * @param window Number of samples fitted by LEAST_SQUARES, clamped to 2..MAX_WINDOW
+     * @param alpha Position gain for ALPHA_BETA, in (0, 1]
+     * @param beta Velocity gain for ALPHA_BETA, in (0, 2)
+     */
+    explicit VelocityEstimator(Method method = DIFFERENCE, int window = 5, double alpha = 0.5, double beta = 0.1) :
+        method_(method),
+        window_(std::max(2, std::min<int>(window, MAX_WINDOW))),
+        alpha_(alpha),
+        beta_(beta)
+    {
+        reset();
+    }
+
+    /**
+     * @brief Look up a method by parameter name: difference, least_squares or alpha_beta
+     * @return false if the name is unknown
+     */
+    static bool parseMethod(const std::string& name, Method& method){
+        if(name == "difference"){
+            method = DIFFERENCE;
+        }else if(name == "least_squares"){
+            method = LEAST_SQUARES;
+        }else if(name == "alpha_beta"){
+            method = ALPHA_BETA;
+        }else{
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Forget all samples, keeping the configuration
+     */
+    void reset(){
+        count_ = 0;
+        head_ = 0;
+        last_time_ = 0;
+        t0_ = 0;
+        sum_t_ = sum_tt_ = 0;
+        for(int i = 0; i < AXES; ++i){
+            vel_[i] = last_[i] = p0_[i] = estimate_[i] = 0;
+            sum_p_[i] = sum_tp_[i] = sum_pp_[i] = 0;
+        }
+    }
+
+    /**
+     * @brief Add a sample and update the estimate
+     * @param time Sample time in seconds
+     * @param position Position on each axis
+     * @param velocity Set to the velocity estimate on each axis
+     */
+    void update(double time, const double* position, double* velocity){
+
+        if(count_ > 0 && time <= last_time_){
+            std::copy(vel_, vel_ + AXES, velocity);
+            return;
+        }
+
+        switch(method_){
+        case LEAST_SQUARES:
+            fit(time, position);
+            break;
+        case ALPHA_BETA:
+            track(time, position);
+            break;
+        default:
+            if(count_ > 0){
+                for(int i = 0; i < AXES; ++i){
+                    vel_[i] = (position[i] - last_[i]) / (time - last_time_);
+                }
+            }
+            break;
+        }
+
+        ++count_;
+        last_time_ = time;
+        std::copy(position, position + AXES, last_);
+        std::copy(vel_, vel_ + AXES, velocity);
+
+    }
+
+    /**
+     * @brief Get the variance of the current estimate, computed from the running sums only when asked for
+     * @param variance Set to the variance of the velocity estimate on each axis, untouched if false is returned
+     * @return false unless the method is LEAST_SQUARES and the window holds more than two samples
+     */
+    bool getVariance(double* variance) const{
+
+        int size = std::min<unsigned long>(count_, window_);
+        if(method_ != LEAST_SQUARES || size < 3){
+            return false;
+        }
+        double stt = sum_tt_ - sum_t_ * sum_t_ / size;
+        if(stt <= 0){
+            return false;
+        }
+        for(int i = 0; i < AXES; ++i){
+            //residual sum of squares around the fitted line, over the standard error of its slope
+            double stp = sum_tp_[i] - sum_t_ * sum_p_[i] / size;
+            double spp = sum_pp_[i] - sum_p_[i] * sum_p_[i] / size;
+            variance[i] = std::max(0.0, spp - stp * stp / stt) / (size - 2) / stt;
+        }
+        return true;
+
+    }
+
+private:
+
+    struct Sample{
+        double t, p[AXES];
+    };
+
+    void fit(double time, const double* position){
+
+        //keep sums relative to a recent reference, so they do not lose precision as time and position grow
+        if(count_ == 0){
+            t0_ = time;
+            std::copy(position, position + AXES, p0_);
+        }
+
+        int size = std::min<unsigned long>(count_, window_);
+        Sample& slot = ring_[head_];
+        if(size == window_){
+            remove(slot);
+        }else{
+            ++size;
+        }
+        slot.t = time - t0_;
+        for(int i = 0; i < AXES; ++i){
+            slot.p[i] = position[i] - p0_[i];
+        }
+        add(slot);
+        head_ = (head_ + 1) % window_;
+
+        //rebase once per window, which keeps the cost per sample constant
+        if(head_ == 0){
+            rebase(time, position);
+        }
+
+        if(size < 2){
+            return;
+        }
+        double denominator = size * sum_tt_ - sum_t_ * sum_t_;
+        if(denominator <= 0){
+            return;
+        }
+        for(int i = 0; i < AXES; ++i){
+            vel_[i] = (size * sum_tp_[i] - sum_t_ * sum_p_[i]) / denominator;
+        }
+
+    }
+
+    void add(const Sample& sample){
+        sum_t_ += sample.t;
+        sum_tt_ += sample.t * sample.t;
+        for(int i = 0; i < AXES; ++i){
+            sum_p_[i] += sample.p[i];
+            sum_tp_[i] += sample.t * sample.p[i];
+            sum_pp_[i] += sample.p[i] * sample.p[i];
+        }
+    }
+
+    void remove(const Sample& sample){
+        sum_t_ -= sample.t;
+        sum_tt_ -= sample.t * sample.t;
+        for(int i = 0; i < AXES; ++i){
+            sum_p_[i] -= sample.p[i];
+            sum_tp_[i] -= sample.t * sample.p[i];
+            sum_pp_[i] -= sample.p[i] * sample.p[i];
+        }
+    }
+
+    void rebase(double time, const double* position){
+        double dt = t0_ - time;
+        double dp[AXES];
+        for(int i = 0; i < AXES; ++i){
+            dp[i] = p0_[i] - position[i];
+        }
+        t0_ = time;
+        std::copy(position, position + AXES, p0_);
+
+        //recompute the sums from scratch, which also drops accumulated rounding error
+        sum_t_ = sum_tt_ = 0;
+        for(int i = 0; i < AXES; ++i){
+            sum_p_[i] = sum_tp_[i] = sum_pp_[i] = 0;
+        }
+        int size = std::min<unsigned long>(count_ + 1, window_);
+        for(int k = 0; k < size; ++k){
+            Sample& sample = ring_[k];
+            sample.t += dt;
+            for(int i = 0; i < AXES; ++i){
+                sample.p[i] += dp[i];
+            }
+            add(sample);
+        }
+    }
+
+    void track(double time, const double* position){
+        if(count_ == 0){
+            std::copy(position, position + AXES, estimate_);
+            return;
+        }
+        double dt = time - last_time_;
+        for(int i = 0; i < AXES; ++i){
+            double predicted = estimate_[i] + vel_[i] * dt;
+            double residual = position[i] - predicted;
+            estimate_[i] = predicted + alpha_ * residual;
+            vel_[i] += beta_ / dt * residual;
+        }
+    }
+
+    Method method_;
+    int window_;
+    double alpha_, beta_;
+
+    unsigned long count_;
+    double last_time_, last_[AXES], vel_[AXES];
+
+    //least squares ring buffer and running sums, relative to t0_ and p0_
+    Sample ring_[MAX_WINDOW];
+    int head_;
+    double t0_, p0_[AXES];
+    double sum_t_, sum_tt_, sum_p_[AXES], sum_tp_[AXES], sum_pp_[AXES];
+
+    //alpha-beta position estimate
+    double estimate_[AXES];
+
+};
+
+}
+
+#endif
@@ -1,313 +1,1043 @@
-#include <ros/ros.h>
-#include <std_msgs/String.h>
-#include <geometry_msgs/Twist.h>
-#include <nav_msgs/Odometry.h>
-#include <tf/transform_broadcaster.h>
+#include <nav2_driver/nav2_driver.h>
 
-#include <nav2_driver/nav2remote.h>
+#include <boost/make_shared.hpp>
 
-#include <boost/interprocess/smart_ptr/shared_ptr.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <sstream>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 namespace nav2_driver{
 
-/**
- * @brief ROS Driver/Wrapper for nav2remote Remote API, implementing standard mobile robot subscribers, publishers, and tf frames as per REP 105.
- */
-class Nav2Driver{
-
-public:
-
-    /**
-     * @brief Constructor for driver node
-     * @param name Name of node
-     */
-    Nav2Driver(std::string name) :
-        nh_(),
-        private_nh_("~"),
-        robot_prefix_()
-    {
+Nav2Driver::Nav2Driver(ros::NodeHandle nh, ros::NodeHandle private_nh) :
+    nh_(nh),
+    private_nh_(private_nh),
+    reconnect_requested_(true),
+    reconnect_running_(true),
+    remote_pending_(false),
+    link_up_(false),
+    robot_prefix_(),
+    io_running_(false),
+    wake_fd_(-1),
+    cmd_sent_(0),
+    cmd_coalesced_(0),
+    cmd_skipped_(0),
+    watchdog_fd_(-1),
+    motion_cancel_(false),
+    motion_ready_(false),
+    motion_active_(false),
+    motion_generation_(0),
+    motion_base_(0),
+    motion_count_(0),
+    motion_reported_(0),
+    config_level_(0),
+    config_ready_(false),
+    max_speed_(-1.0),
+    max_accel_(-1.0),
+    max_cornering_error_(-1.0),
+    limits_dirty_(false),
+    reconnects_(0),
+    connect_failures_(0),
+    poll_overruns_(0),
+    tf_skipped_(0),
+    diagnostics_(nh, private_nh)
+{
+
+    //get robot address and port
+    private_nh_.param<std::string>("robot_address", robot_address_, "");
+    if(robot_address_.empty()){
+        std::string message = "Please provide address for Nav2";
+        ROS_ERROR_STREAM(message);
+        throw std::runtime_error(message);
+    }
+    private_nh_.param<int>("robot_port", robot_port_, 5010);
+
+    //get connection timeout, and backoff between failed connection attempts
+    private_nh_.param<double>("connect_timeout", connect_timeout_, 1.0);
+    private_nh_.param<double>("reconnect_backoff_min", backoff_min_, 0.2);
+    private_nh_.param<double>("reconnect_backoff_max", backoff_max_, 5.0);
+
+    //get socket tuning, by default send short commands immediately and drop a dead link within a few seconds
+    private_nh_.param<bool>("tcp_nodelay", socket_options_.noDelay, true);
+    private_nh_.param<bool>("tcp_keepalive", socket_options_.keepAlive, true);
+    private_nh_.param<int>("tcp_keepalive_idle", socket_options_.keepAliveIdle, 2);
+    private_nh_.param<int>("tcp_keepalive_interval", socket_options_.keepAliveInterval, 1);
+    private_nh_.param<int>("tcp_keepalive_count", socket_options_.keepAliveCount, 3);
+    private_nh_.param<double>("socket_recv_timeout", socket_options_.recvTimeout, 1.0);
+    private_nh_.param<double>("socket_send_timeout", socket_options_.sendTimeout, 1.0);
+    private_nh_.param<int>("socket_priority", socket_options_.priority, -1);
+    private_nh_.param<int>("socket_tos", socket_options_.tos, -1);
+    private_nh_.param<bool>("socket_timestamps", socket_options_.timestamps, true);
+
+    //optionally send velocity commands as sequence numbered datagrams, so they never wait behind a retransmission
+    private_nh_.param<int>("velocity_udp_port", socket_options_.velocityPort, 0);
+
+    //get optional traffic log file, written from a background thread and optionally through a memory mapping
+    std::string traffic_log;
+    bool traffic_log_mmap;
+    int traffic_log_buffer;
+    private_nh_.param<std::string>("traffic_log", traffic_log, "");
+    private_nh_.param<bool>("traffic_log_mmap", traffic_log_mmap, false);
+    private_nh_.param<int>("traffic_log_buffer", traffic_log_buffer, 1 << 20);
+    if(!traffic_log.empty()){
+        try{
+            traffic_log_.reset(new TrafficLog(traffic_log, traffic_log_buffer, traffic_log_mmap));
+        }catch(std::exception& e){
+            std::string message = std::string(e.what()) + ": " + traffic_log;
+            ROS_ERROR_STREAM(message);
+            throw std::runtime_error(message);
+        }
+    }
+
+    //get parameter for unique tf names
+    std::string robot_name;
+    private_nh_.param<std::string>("robot_name", robot_name, "");
+    if (!robot_name.empty()) { robot_prefix_ = robot_name + "_"; }
+
+    //get parameter for inverted odometry (for use with robot_pose_ekf)
+    private_nh_.param<bool>("invert_odom", invert_odom_, false);
+
+    //get tf parameters: the fixed base_link frame goes out once on /tf_static if enabled, off by default as robot
+    //models usually provide it, and for multiple robots an unchanged odometry transform is only repeated every
+    //tf_keepalive seconds
+    bool publish_base_link, tf_skip_unchanged;
+    double tf_keepalive;
+    private_nh_.param<bool>("publish_base_link", publish_base_link, false);
+    private_nh_.param<bool>("tf_skip_unchanged", tf_skip_unchanged, !robot_name.empty());
+    private_nh_.param<double>("tf_keepalive", tf_keepalive, 0.1);
+    odom_transform_ = TransformCache(tf_skip_unchanged, tf_keepalive);
+    if(publish_base_link){
+        geometry_msgs::TransformStamped base_link;
+        initStaticTransform(robot_prefix_, base_link);
+        static_broadcaster_.sendTransform(base_link);
+    }
+
+    //get parameter for running socket I/O on a dedicated thread
+    private_nh_.param<bool>("io_thread", io_thread_, false);
+
+    //callbacks on several spinner threads must not share the socket, so leave it to the I/O thread
+    int spinner_threads;
+    private_nh_.param<int>("spinner_threads", spinner_threads, 1);
+    if(spinner_threads > 1 && !io_thread_){
+        ROS_INFO("Using the I/O thread for %d spinner threads", spinner_threads);
+        io_thread_ = true;
+    }
+
+    //get odometry poll rate, and optionally adapt it to the link round trip time up to a maximum rate
+    double odom_rate, odom_rate_max;
+    bool adaptive_odom;
+    private_nh_.param<double>("odom_rate", odom_rate, 10.0);
+    private_nh_.param<bool>("adaptive_odom", adaptive_odom, false);
+    private_nh_.param<double>("odom_rate_max", odom_rate_max, 50.0);
+    if(odom_rate <= 0.0){
+        std::string message = "Odometry rate must be positive";
+        ROS_ERROR_STREAM(message);
+        throw std::runtime_error(message);
+    }
+    poll_scheduler_ = PollScheduler(odom_rate, odom_rate_max, adaptive_odom);
+    updateLinkStats();
+
+    //get parameter for streaming odometry, keeping queries in flight instead of polling at odom_rate
+    private_nh_.param<bool>("odom_stream", odom_stream_, false);
+    private_nh_.param<int>("odom_stream_depth", odom_stream_depth_, 1);
+
+    //get twist estimation method, a sliding least squares fit or alpha-beta filter is much smoother at high poll rates
+    std::string velocity_filter;
+    int velocity_window;
+    double velocity_alpha, velocity_beta;
+    private_nh_.param<std::string>("velocity_filter", velocity_filter, "least_squares");
+    private_nh_.param<int>("velocity_window", velocity_window, 5);
+    private_nh_.param<double>("velocity_alpha", velocity_alpha, 0.5);
+    private_nh_.param<double>("velocity_beta", velocity_beta, 0.1);
+    VelocityEstimator::Method velocity_method;
+    if(!VelocityEstimator::parseMethod(velocity_filter, velocity_method)){
+        std::string message = "Unknown velocity_filter " + velocity_filter +
+                              ", use difference, least_squares or alpha_beta";
+        ROS_ERROR_STREAM(message);
+        throw std::runtime_error(message);
+    }
+    velocity_estimator_ = VelocityEstimator(velocity_method, velocity_window, velocity_alpha, velocity_beta);
+    base_odom_ = BaseOdometry(Pose2D(), velocity_estimator_);
+
+    //get pose and twist covariance, each as 6 diagonal or 36 row-major values, filled into the message template once
+    private_nh_.param<bool>("adaptive_twist_covariance", odom_covariance_.adaptive_twist, false);
+    if(!OdometryCovariance::load(private_nh_, "pose_covariance", odom_covariance_.pose) ||
+       !OdometryCovariance::load(private_nh_, "twist_covariance", odom_covariance_.twist)){
+        std::string message = "Covariance parameters need 6 diagonal or 36 row-major numbers, "
+                              "with a non-negative diagonal";
+        ROS_ERROR_STREAM(message);
+        throw std::runtime_error(message);
+    }
+
+    //get velocity command rate limit, and how much a command must change to be sent before the keepalive is due
+    double cmd_rate_max, cmd_epsilon, cmd_keepalive;
+    private_nh_.param<double>("cmd_rate_max", cmd_rate_max, 20.0);
+    private_nh_.param<double>("cmd_epsilon", cmd_epsilon, 1e-3);
+    private_nh_.param<double>("cmd_keepalive", cmd_keepalive, 0.5);
+    cmd_coalescer_ = CommandCoalescer<VelocityCommand>(cmd_rate_max, cmd_epsilon, cmd_keepalive);
+
+    //get velocity command timeout, after which the base is stopped, 0 to keep executing the last command
+    double cmd_timeout;
+    private_nh_.param<double>("cmd_timeout", cmd_timeout, 1.0);
+    watchdog_ = CommandWatchdog(cmd_timeout);
+
+    nav_msgs::Odometry odom_template;
+    initOdometryMessages(robot_prefix_, invert_odom_, odom_covariance_, odom_template, odom_transform_.getTransform());
+    odom_pool_ = MessagePool<nav_msgs::Odometry>(odom_template);
+
+    //odometry transforms go out the same way, on /tf like tf::TransformBroadcaster but without building a new message
+    tf2_msgs::TFMessage tf_template;
+    tf_template.transforms.push_back(odom_transform_.getTransform());
+    tf_pool_ = MessagePool<tf2_msgs::TFMessage>(tf_template);
+
+    //get optional shared memory segment for odometry, read by co-located consumers without going through TCPROS
+    std::string odom_shm;
+    int odom_shm_capacity;
+    private_nh_.param<std::string>("odom_shm", odom_shm, "");
+    private_nh_.param<int>("odom_shm_capacity", odom_shm_capacity, 64);
+    if(!odom_shm.empty()){
+        try{
+            odom_shm_.reset(new ShmOdometryWriter(odom_shm, std::max(odom_shm_capacity, 1)));
+        }catch(std::exception& e){
+            std::string message = e.what();
+            ROS_ERROR_STREAM(message);
+            throw std::runtime_error(message);
+        }
+    }
 
-        //get robot address and port
-        private_nh_.param<std::string>("robot_address", robot_address_, "");
-        if(robot_address_.empty()){
-            std::string message = "Please provide address for Nav2";
+    //in threaded or streaming mode the timer only publishes snapshots, otherwise it is rescheduled after every poll
+    odom_pub_ = nh_.advertise<nav_msgs::Odometry>("odom", 10);
+    tf_pub_ = nh_.advertise<tf2_msgs::TFMessage>("/tf", 100);
+    odom_loop_ = nh_.createTimer(ros::Duration(poll_scheduler_.getMinPeriod()),
+                                 &Nav2Driver::publishOdometry, this, !io_thread_ && !odom_stream_);
+    cmd_sub_ = nh_.subscribe("cmd_vel", 1, &Nav2Driver::setVelocity, this);
+    if(!io_thread_){
+        cmd_timer_ = nh_.createTimer(ros::Duration(1.0), &Nav2Driver::sendVelocity, this, true, false);
+        if(watchdog_.isEnabled()){
+            watchdog_timer_ = nh_.createWallTimer(ros::WallDuration(watchdog_.getTimeout()),
+                                                  &Nav2Driver::watchdogTimeout, this, true, false);
+        }
+    }
+
+    //motion primitives are queued on the base, which executes them without closing the loop over the network
+    bool motion_server;
+    private_nh_.param<bool>("motion_server", motion_server, true);
+    if(motion_server){
+        motion_server_.reset(new MotionServer(nh_, "motion", false));
+        motion_server_->registerGoalCallback(boost::bind(&Nav2Driver::motionGoal, this));
+        motion_server_->registerPreemptCallback(boost::bind(&Nav2Driver::motionPreempt, this));
+        motion_server_->start();
+    }
+
+    //turtle command limits and poll rates can be changed at runtime, without dropping the connection
+    reconfigure_server_.reset(new dynamic_reconfigure::Server<Nav2DriverConfig>(private_nh_));
+    reconfigure_server_->setCallback(boost::bind(&Nav2Driver::reconfigure, this, _1, _2));
+
+    //diagnostics are rate limited by the updater itself (~diagnostic_period)
+    std::ostringstream hardware_id;
+    hardware_id << robot_address_ << ":" << robot_port_;
+    diagnostics_.setHardwareID(hardware_id.str());
+    diagnostics_.add("Nav2 base link", this, &Nav2Driver::updateDiagnostics);
+    diagnostics_timer_ = nh_.createTimer(ros::Duration(1.0), &Nav2Driver::publishDiagnostics, this);
+
+    if(io_thread_){
+        wake_fd_ = eventfd(0, EFD_NONBLOCK);
+        if(wake_fd_ < 0){
+            std::string message = "Failed to create I/O thread wakeup descriptor";
             ROS_ERROR_STREAM(message);
             throw std::runtime_error(message);
         }
-        private_nh_.param<int>("robot_port", robot_port_, 5010);
+        if(watchdog_.isEnabled()){
+            watchdog_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+            if(watchdog_fd_ < 0){
+                std::string message = "Failed to create command watchdog timer";
+                ROS_ERROR_STREAM(message);
+                throw std::runtime_error(message);
+            }
+        }
+    }
+
+    //connect in the background, callbacks skip their work until the link is up
+    reconnect_thread_ = boost::thread(&Nav2Driver::reconnectLoop, this);
+
+    if(io_thread_){
+        io_running_ = true;
+        io_thread_handle_ = boost::thread(&Nav2Driver::ioLoop, this);
+    }
+}
+
+Nav2Driver::~Nav2Driver(){
+    if(io_thread_handle_.joinable()){
+        io_running_ = false;
+        wake();
+        io_thread_handle_.join();
+    }
+    {
+        boost::mutex::scoped_lock lock(link_mutex_);
+        reconnect_running_ = false;
+        link_cond_.notify_all();
+    }
+    reconnect_thread_.join();
+    if(wake_fd_ >= 0){
+        close(wake_fd_);
+    }
+    if(watchdog_fd_ >= 0){
+        close(watchdog_fd_);
+    }
+}
+
+bool Nav2Driver::haveRemote(){
+
+    if(remote_){
+        return true;
+    }
+    if(!remote_pending_.load(boost::memory_order_acquire)){
+        return false;
+    }
+
+    boost::mutex::scoped_lock lock(link_mutex_);
+    remote_.swap(pending_remote_);
+    remote_pending_ = false;
+
+    //the base may have restarted, so send the configured limits again
+    limits_dirty_ = max_speed_ >= 0.0 || max_accel_ >= 0.0 || max_cornering_error_ >= 0.0;
+    return remote_.get() != NULL;
 
-        //get parameter for unique tf names
-        std::string robot_name;
-        private_nh_.param<std::string>("robot_name", robot_name, "");
-        if (!robot_name.empty()) { robot_prefix_ = robot_name + "_"; }
+}
 
-        //get parameter for inverted odometry (for use with robot_pose_ekf)
-        private_nh_.param<bool>("invert_odom", invert_odom_, false);
+void Nav2Driver::linkDown(){
 
-        connect(robot_address_, robot_port_);
+    abortMotion("Lost connection to Nav2 base");
+    if(remote_){
+        ROS_WARN("Lost connection to Nav2 base, reconnecting");
+        remote_.reset();
+        cmd_coalescer_.reset();
+        ++reconnects_;
 
-        odom_pub_ = nh_.advertise<nav_msgs::Odometry>("odom", 10);
-        odom_loop_ = nh_.createTimer(ros::Duration(0.1), boost::bind(&Nav2Driver::publishOdometry, this, invert_odom_, robot_prefix_));
-        cmd_sub_ = nh_.subscribe("cmd_vel", 5, &Nav2Driver::setVelocity, this);
+        //save odometry offset for new base connection odometry
+        Pose2D offset = base_odom_.getOffsetPose();
+        base_odom_ = BaseOdometry(offset, velocity_estimator_);
     }
+    link_up_ = false;
+
+    boost::mutex::scoped_lock lock(link_mutex_);
+    reconnect_requested_ = true;
+    link_cond_.notify_all();
+
+}
 
-protected:
+void Nav2Driver::reconnectLoop(){
 
-    /**
-     * @brief Establishes connection to Nav2 base controller on specified IP and port, replacing any existing
-     * connection if necessary. Throws std::runtime_error if cannot connect to base controller.
-     */
-    void connect(std::string robot_address, int robot_port){
+    unsigned int seed = time(NULL) ^ (getpid() << 16);
+    double backoff = backoff_min_;
 
-        //check if already connected
-        if(remote_){
-            ROS_INFO("Resetting connection to Nav2 base");
-            remote_.reset();
+    boost::mutex::scoped_lock lock(link_mutex_);
+    while(reconnect_running_){
 
-            //save odometry offset for new base connection odometry
-            Pose2D offset = base_odom_.getPose();
-            base_odom_ = BaseOdometry(offset);
+        if(!reconnect_requested_){
+            link_cond_.wait(lock);
+            continue;
         }
 
-        //attempt to connect several times, if failed then die
-        int retry = 5;
-        while(retry-- > 0){
-            try{
-                //leave address:port validation to Nav2Remote. Must use shared_ptr since constructor can throw expception
-                remote_ = boost::shared_ptr<Nav2Remote>(new Nav2Remote(robot_address.c_str(),robot_port));
-                ROS_INFO_STREAM("Connected to Nav2 base on " << robot_address <<":"<< robot_port);
-                return;
-            }catch(std::exception& e){
-                ROS_WARN_STREAM(e.what());
-                ros::Duration(0.2).sleep();
+        //connect without holding the lock, the owner may be checking for a new connection meanwhile
+        lock.unlock();
+        boost::shared_ptr<Nav2Remote> remote;
+        try{
+            //leave address:port validation to Nav2Remote. Must use shared_ptr since constructor can throw expception
+            remote = boost::shared_ptr<Nav2Remote>(new Nav2Remote(robot_address_.c_str(), robot_port_, connect_timeout_,
+                                                                socket_options_));
+            remote->setTrafficLog(traffic_log_.get());
+        }catch(std::exception& e){
+            ROS_WARN_STREAM_THROTTLE(5.0, "Failed to connect to Nav2 base on " << robot_address_ << ":" << robot_port_
+                                     << ": " << e.what());
+            ++connect_failures_;
+        }
+        lock.lock();
+
+        if(remote){
+            ROS_INFO_STREAM("Connected to Nav2 base on " << robot_address_ << ":" << robot_port_);
+            pending_remote_ = remote;
+            remote_pending_ = true;
+            link_up_ = true;
+            reconnect_requested_ = false;
+            backoff = backoff_min_;
+            if(io_thread_){
+                wake();
             }
+            continue;
         }
 
-        std::string message = "Failed to connect to Nav2 base";
-        ROS_ERROR_STREAM(message << " on " << robot_address_ <<":"<< robot_port_);
-        throw std::runtime_error(message);
+        //back off exponentially, with jitter so several drivers do not retry in lockstep
+        const double jitter = 0.25;
+        double delay = backoff * (1.0 + jitter * (2.0 * rand_r(&seed) / RAND_MAX - 1.0));
+        backoff = std::min(backoff * 2.0, backoff_max_);
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds((long)(delay * 1e6));
+        while(reconnect_running_ && link_cond_.timed_wait(lock, deadline)) {}
 
     }
 
-    /**
-     * @brief Retrieves latest odometry information from the base controller, and publishes appropriate message and transforms
-     * @param invert_odom Invert odometry for use with robot_pose_ekf
-     * @param robot_prefix Tf prefix to use with odom and base_link frame
-     */
-    void publishOdometry(bool invert_odom, std::string robot_prefix){
+}
 
-        //get odometry from Nav2, reconnect on error
-        Pose2D data;
-        while(!remote_ || remote_->estimatePosition(data.x, data.y, data.th) < 0){
-            connect(robot_address_, robot_port_);
+void Nav2Driver::publishState(const BaseOdometry& odom){
+    odom_age_hist_.record((ros::Time::now() - odom.getStamp()).toSec());
+
+    if(odom_transform_.update(odom, invert_odom_)){
+        tf2_msgs::TFMessagePtr transforms = tf_pool_.next();
+        odom_transform_.copyTo(transforms->transforms[0]);
+        tf_pub_.publish(tf2_msgs::TFMessageConstPtr(transforms));
+    }else{
+        tf_skipped_.store(odom_transform_.getSkipped(), boost::memory_order_relaxed);
+    }
+
+    nav_msgs::OdometryPtr message = odom_pool_.next();
+    odom.fillMessage(*message);
+    if(odom_covariance_.adaptive_twist){
+        odom.fillTwistCovariance(odom_covariance_.twist, *message);
+    }
+    odom_pub_.publish(nav_msgs::OdometryConstPtr(message));
+
+    if(odom_shm_){
+        Pose2D pose = odom.getOffsetPose(), velocity = odom.getBaseVelocity();
+        ShmOdometrySample sample;
+        sample.stamp = odom.getStamp().toNSec();
+        sample.x = pose.x;
+        sample.y = pose.y;
+        sample.th = pose.th;
+        sample.vx = velocity.x;
+        sample.vy = velocity.y;
+        sample.wz = velocity.th;
+        odom_shm_->write(sample);
+    }
+}
+
+ros::Time Nav2Driver::stampSample(double sent, double received){
+
+    double rtt = received - sent;
+    poll_scheduler_.addRoundTrip(rtt);
+    rtt_hist_.record(rtt);
+    updateLinkStats();
+
+    //wall clock offsets carry over to ROS time, which may be simulated
+    double age = ros::WallTime::now().toSec() - received + 0.5 * poll_scheduler_.getRoundTrip();
+    return ros::Time::now() - ros::Duration(std::max(age, 0.0));
+
+}
+
+void Nav2Driver::publishOdometry(const ros::TimerEvent&){
+
+    if(!io_thread_){
+        applyConfig();
+        checkWatchdog();
+    }
+
+    if(odom_stream_ && !io_thread_){
+        //dispatch whatever stream replies have arrived, without waiting for more
+        double start = ros::WallTime::now().toSec();
+        if(haveRemote() && (startStream() < 0 || remote_->processReplies() < 0)){
+            linkDown();
         }
+        if(odom_snapshot_.read(odom_published_)){
+            publishState(odom_published_);
+        }
+        odom_callback_hist_.record(ros::WallTime::now().toSec() - start);
+        return;
+    }
 
-        //update internal state, and publish required message/tf information
-        base_odom_.updateWithAbsolute(data);
-        tf_broadcaster_.sendTransform(base_odom_.getTransform(invert_odom,robot_prefix));
-        odom_pub_.publish(base_odom_.getMessage(robot_prefix));
+    if(io_thread_){
+        //publish the latest snapshot from the I/O thread, if there is a new one
+        if(odom_snapshot_.read(odom_published_)){
+            publishState(odom_published_);
+        }
+        return;
+    }
 
+    //get odometry from Nav2, reconnect in background on error
+    Pose2D data;
+    double start = ros::WallTime::now().toSec();
+    if(haveRemote()){
+        if(remote_->estimatePosition(data.x, data.y, data.th) < 0){
+            linkDown();
+        }else{
+            //update internal state, and publish required message/tf information
+            base_odom_.updateWithAbsolute(data, stampSample(remote_->getQueryTime(), remote_->getReplyTime()));
+            publishState(base_odom_);
+            updateMotionFeedback();
+        }
     }
+    double now = ros::WallTime::now().toSec();
+
+    //schedule next poll, skipping any that were missed rather than letting them pile up
+    unsigned long overruns = poll_scheduler_.getOverruns();
+    double delay = poll_scheduler_.next(start, ros::WallTime::now().toSec()) - now;
+    if(poll_scheduler_.getOverruns() != overruns){
+        ++poll_overruns_;
+        ROS_WARN_THROTTLE(1.0, "Odometry poll overran its %.1f ms period (%lu overruns so far)",
+                          poll_scheduler_.getPeriod() * 1000.0, poll_scheduler_.getOverruns());
+    }
+    odom_loop_.stop();
+    odom_loop_.setPeriod(ros::Duration(std::max(delay, 0.001)));
+    odom_loop_.start();
+    odom_callback_hist_.record(ros::WallTime::now().toSec() - start);
 
-    /**
-     * @brief Sets velocity goals for base controller
-     * @param twist Incoming velocity command from ROS
-     */
-    void setVelocity(const geometry_msgs::TwistConstPtr& twist){
+}
 
-        //convert from vector velocity to relative angular velocity
-        double vs = sqrt(pow(twist->linear.x,2) + pow(twist->linear.y,2));
-        double vn = atan2(twist->linear.y,twist->linear.x) * (180 / M_PI);
+void Nav2Driver::setVelocity(const geometry_msgs::TwistConstPtr& twist){
+
+    double start = ros::WallTime::now().toSec();
+
+    VelocityCommand command;
+    command.vx = twist->linear.x;
+    command.vy = twist->linear.y;
+    command.wz = twist->angular.z;
+    if(!command.isValid()){
+        ROS_ERROR_THROTTLE(1.0, "Ignoring velocity command with components out of range");
+        return;
+    }
 
-        //send velocity command to Nav2, reconnect on error
-        while(!remote_ || remote_->setRelativeVelocity(vn, vs, twist->angular.z) < 0){
-            connect(robot_address_, robot_port_);
+    //hand off to I/O thread, where only the newest command is sent
+    if(io_thread_){
+        cmd_mailbox_.write(command);
+        wake();
+    }else{
+        cmd_coalescer_.offer(command);
+        feedWatchdog(command);
+        flushVelocity(start);
+
+        //send a command held back by the rate limit once it is due
+        double due = cmd_coalescer_.getNextDue();
+        if(due < std::numeric_limits<double>::max()){
+            cmd_timer_.stop();
+            cmd_timer_.setPeriod(ros::Duration(std::max(due - start, 0.001)));
+            cmd_timer_.start();
         }
     }
 
-private:
+    cmd_callback_hist_.record(ros::WallTime::now().toSec() - start);
+}
+
+void Nav2Driver::sendVelocity(const ros::TimerEvent&){
+    flushVelocity(ros::WallTime::now().toSec());
+}
+
+void Nav2Driver::feedWatchdog(const VelocityCommand& command){
+    if(watchdog_.isEnabled()){
+        watchdog_.feed(CommandWatchdog::now(), command.vx != 0.0 || command.vy != 0.0 || command.wz != 0.0);
+        armWatchdogTimer();
+    }
+}
 
-    /**
-     * @brief Internal structure for storing pose representation in 2D
-     */
-    struct Pose2D{
+void Nav2Driver::armWatchdogTimer(){
 
-        Pose2D() : x(0), y(0), th(0) {}
-        Pose2D(double x, double y, double th) : x(x), y(y), th(th) {}
-        double x, y, th;
-        Pose2D& operator +=(Pose2D const& other) {
-            x += other.x;
-            y += other.y;
-            th += other.th;
-            return *this;
+    if(io_thread_){
+        //absolute deadline, so a late timer update never stretches the timeout
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        if(watchdog_.isArmed()){
+            double deadline = watchdog_.getDeadline();
+            spec.it_value.tv_sec = (time_t)deadline;
+            spec.it_value.tv_nsec = (long)((deadline - spec.it_value.tv_sec) * 1e9);
         }
-        Pose2D& operator -=(Pose2D const& other) {
-            x -= other.x;
-            y -= other.y;
+        timerfd_settime(watchdog_fd_, TFD_TIMER_ABSTIME, &spec, NULL);
+    }else{
+        watchdog_timer_.stop();
+        if(watchdog_.isArmed()){
+            double delay = watchdog_.getDeadline() - CommandWatchdog::now();
+            watchdog_timer_.setPeriod(ros::WallDuration(std::max(delay, 0.001)));
+            watchdog_timer_.start();
+        }
+    }
 
-            //detect rollover during velocity calculation
-            if(abs(th - other.th) > M_PI){
-                if(other.th>0){
-                    th += 2*M_PI;
-                }else{
-                    th -= 2*M_PI;
-                }
+}
+
+void Nav2Driver::checkWatchdog(){
+
+    double now = CommandWatchdog::now();
+    if(!watchdog_.due(now) || !haveRemote()){
+        return;
+    }
+    if(remote_->stop() < 0){
+        linkDown();
+        return;
+    }
+    watchdog_hist_.record(watchdog_.stopped(now));
+    armWatchdogTimer();
+
+    //the next command must go out even if it equals the one the base was executing
+    cmd_coalescer_.reset();
+    ROS_WARN_THROTTLE(1.0, "No velocity command for %.2f s, stopping Nav2 base", watchdog_.getTimeout());
+
+}
+
+void Nav2Driver::watchdogTimeout(const ros::WallTimerEvent&){
+    checkWatchdog();
+
+    //woken early by a wall clock step, wait for the rest of the timeout. A stop held back by a link that is down
+    //goes out from publishOdometry instead
+    if(watchdog_.isArmed() && !watchdog_.due(CommandWatchdog::now())){
+        armWatchdogTimer();
+    }
+}
+
+void Nav2Driver::flushVelocity(double now){
+
+    VelocityCommand command;
+    if(cmd_coalescer_.poll(now, command)){
+        if(!haveRemote()){
+            //never hold up the caller waiting for the link, a stale command is of no use later anyway
+            ROS_WARN_THROTTLE(1.0, "Not connected to Nav2 base, dropping velocity command");
+            cmd_coalescer_.reset();
+        }else{
+            if(command.send(*remote_) < 0){
+                linkDown();
+            }else{
+                ++cmd_sent_;
             }
-            th -= other.th;
-            return *this;
-        }
-        Pose2D& operator /=(double const& other) {
-            x /= other;
-            y /= other;
-            th /= other;
-            return *this;
         }
-        inline Pose2D& operator +(const Pose2D& other) { return *this += other; }
-        inline Pose2D& operator -(const Pose2D& other) { return *this -= other; }
-        inline Pose2D& operator /(const double& other) { return *this /= other; }
+    }
 
-    };
+    cmd_coalesced_.store(cmd_coalescer_.getCoalesced(), boost::memory_order_relaxed);
+    cmd_skipped_.store(cmd_coalescer_.getSkipped(), boost::memory_order_relaxed);
 
-    /**
-     * @brief Internal class for building and representing the base odometry state.
-     */
-    class BaseOdometry{
+}
+
+void Nav2Driver::ioLoop(){
 
-    public:
+    double next_poll = ros::WallTime::now().toSec();
 
-        /**
-         * @brief Initialize state to 0,0,0
-         */
-        BaseOdometry(): last_time_(ros::Time::now()) {}
+    while(io_running_){
 
-        /**
-         * @brief Initialize state with offset, usually if connection to base was reset
-         * @param offset Pose offset to use
-         */
-        BaseOdometry(Pose2D offset): offset_(offset), last_time_(ros::Time::now()) {}
+        //sleep until a velocity command, a reply, a new connection, or the next odometry poll or command is due
+        double due = std::min(odom_stream_ ? std::numeric_limits<double>::max() : next_poll,
+                              cmd_coalescer_.getNextDue());
+        int timeout = std::max(0.0, (due - ros::WallTime::now().toSec()) * 1000.0);
+        struct pollfd fds[3];
+        fds[0].fd = wake_fd_;
+        fds[0].events = POLLIN;
+        fds[1].fd = haveRemote() ? remote_->getFd() : -1;
+        fds[1].events = POLLIN;
+        fds[2].fd = watchdog_fd_;
+        fds[2].events = POLLIN;
+        poll(fds, 3, timeout);
 
-        void updateWithAbsolute(Pose2D abs){
-            updateWithRelative(abs - prev_);
-            prev_ = abs;
+        if(fds[0].revents & POLLIN){
+            uint64_t count;
+            if(read(wake_fd_, &count, sizeof(count)) < 0) { /* already drained */ }
+        }
+        if(fds[2].revents & POLLIN){
+            uint64_t expirations;
+            if(read(watchdog_fd_, &expirations, sizeof(expirations)) < 0) { /* rearmed meanwhile */ }
         }
 
-        void updateWithRelative(Pose2D delta){
-            double elapsed = (ros::Time::now() - last_time_).toSec();
-            last_time_ = ros::Time::now();
+        //dispatch position replies and drain anything else the base sent, so a readable socket never spins this loop.
+        //Reconnect in background on error, or once the base hangs up
+        if(haveRemote() && remote_->processReplies() < 0){
+            linkDown();
+        }
 
-            pose_ += delta;
-            vel_ = delta / elapsed;
+        //collect this iteration's commands, so a velocity command and a position query share one write
+        if(haveRemote()){
+            remote_->beginBatch();
+        }
 
+        //queue a new motion goal, or clear a cancelled one, in the same write
+        if(motion_ready_){
+            runMotion();
         }
+        applyConfig();
 
-        /**
-         * @brief Build transform from internal odometry state
-         * @param invert_odom Invert odometry for use with robot_pose_ekf
-         * @param robot_prefix Tf prefix to use with odom and base_link frame
-         * @return transform
-         */
-        geometry_msgs::TransformStamped getTransform(bool invert_odom, std::string robot_prefix){
+        //send velocity command to Nav2 once the rate limit allows, dropping it while the link is down
+        VelocityCommand command;
+        if(cmd_mailbox_.read(command)){
+            cmd_coalescer_.offer(command);
+            feedWatchdog(command);
+        }
 
-            //build transform message
-            geometry_msgs::TransformStamped transform;
-            transform.header.stamp = last_time_;
+        //stop the base once commands have gone stale, in this iteration's batch
+        checkWatchdog();
 
-            //invert odometry if necessary
-            tf::Transform temp = tf::Transform(tf::createQuaternionFromYaw(pose_.th + offset_.th), tf::Vector3(pose_.x + offset_.x, pose_.y + offset_.y, 0));
-            if(invert_odom){
-                temp = temp.inverse();
-                transform.header.frame_id = robot_prefix + "base_footprint";
-                transform.child_frame_id = robot_prefix + "odom";
+        double now = ros::WallTime::now().toSec();
+        flushVelocity(now);
+
+        //request next position sample, unless the previous one is still outstanding or a stream is running
+        if(odom_stream_){
+            if(haveRemote() && startStream() < 0){
+                linkDown();
+            }
+        }else if(now >= next_poll){
+            bool overrun = false;
+            if(!haveRemote()){
+                //nothing to poll, check again next period
+            }else if(remote_->getPendingReplies() == 0){
+                if(remote_->estimatePositionAsync(boost::bind(&Nav2Driver::handlePosition, this, _1, _2, _3, _4)) < 0){
+                    linkDown();
+                }
             }else{
-                transform.header.frame_id = robot_prefix + "odom";
-                transform.child_frame_id = robot_prefix + "base_footprint";
+                overrun = true;
+                ROS_WARN_THROTTLE(1.0, "Odometry poll overran its %.1f ms period, reply still outstanding",
+                                  poll_scheduler_.getPeriod() * 1000.0);
             }
-            tf::transformTFToMsg(temp, transform.transform);
 
-            return transform;
+            //schedule from the deadline this poll was due at, so that a loop waking up a period late is an overrun too
+            unsigned long overruns = poll_scheduler_.getOverruns();
+            next_poll = poll_scheduler_.next(next_poll, now);
+            if(overrun || poll_scheduler_.getOverruns() != overruns){
+                ++poll_overruns_;
+            }
+        }
 
+        if(remote_ && remote_->commitBatch() < 0){
+            linkDown();
         }
+    }
+
+}
+
+int Nav2Driver::startStream(){
+    if(remote_->isStreaming()){
+        return 0;
+    }
+    return remote_->startPositionStream(boost::bind(&Nav2Driver::handlePosition, this, _1, _2, _3, _4),
+                                        odom_stream_depth_);
+}
+
+void Nav2Driver::handlePosition(int rc, double x, double y, double th){
+    if(rc < 0){
+        return;
+    }
+    base_odom_.updateWithAbsolute(Pose2D(x, y, th), stampSample(remote_->getQueryTime(), remote_->getReplyTime()));
+    odom_snapshot_.write(base_odom_);
+    updateMotionFeedback();
+}
 
-        /**
-         * @brief Build Odometry message from internal odometry state
-         * @param robot_prefix Tf prefix to use with odom and base_link frame
-         * @return odometry message
-         */
-        nav_msgs::Odometry getMessage(std::string robot_prefix){
+void Nav2Driver::motionGoal(){
 
-            //build odometry message
-            nav_msgs::Odometry message;
+    //the action server has already preempted any active goal, the owner of remote_ clears its primitives
+    MotionGoalConstPtr goal = motion_server_->acceptNewGoal();
+    {
+        boost::mutex::scoped_lock lock(motion_mutex_);
+        motion_goal_ = goal;
+        motion_cancel_ = false;
+    }
+    motion_ready_ = true;
+    if(io_thread_){
+        wake();
+    }else{
+        runMotion();
+    }
 
-            message.header.stamp = last_time_;
-            message.header.frame_id = robot_prefix + "odom";
-            message.child_frame_id = robot_prefix + "base_link";
-            message.pose.pose.position.x = pose_.x + offset_.x;
-            message.pose.pose.position.y = pose_.y + offset_.y;
-            message.pose.pose.position.z = 0.0;
-            message.pose.pose.orientation = tf::createQuaternionMsgFromYaw(pose_.th + offset_.th);
-            message.pose.covariance[0] = 10^-3;
-            message.pose.covariance[7] = 10^-3;
-            message.pose.covariance[14] = 10^6;
-            message.pose.covariance[21] = 10^6;
-            message.pose.covariance[28] = 10^6;
-            message.pose.covariance[35] = 10^3;
+}
 
-            message.twist.twist.linear.x = vel_.x;
-            message.twist.twist.linear.y = vel_.y;
-            message.twist.twist.angular.z = vel_.th;
-            message.twist.covariance[0] = 10^-3;
-            message.twist.covariance[7] = 10^-3;
-            message.twist.covariance[14] = 10^6;
-            message.twist.covariance[21] = 10^6;
-            message.twist.covariance[28] = 10^6;
-            message.twist.covariance[35] = 10^3;
+void Nav2Driver::motionPreempt(){
 
-            return message;
+    {
+        boost::mutex::scoped_lock lock(motion_mutex_);
+        motion_goal_.reset();
+        motion_cancel_ = true;
+    }
+    motion_ready_ = true;
+    if(io_thread_){
+        wake();
+    }else{
+        runMotion();
+    }
+
+}
+
+void Nav2Driver::runMotion(){
 
+    MotionGoalConstPtr goal;
+    bool cancel;
+    {
+        boost::mutex::scoped_lock lock(motion_mutex_);
+        motion_ready_ = false;
+        goal.swap(motion_goal_);
+        cancel = motion_cancel_;
+        motion_cancel_ = false;
+    }
+    if(!goal && !cancel){
+        return;
+    }
+
+    //stop the previous goal's primitives, its completion handler is stale from here on
+    ++motion_generation_;
+    if(motion_active_){
+        motion_active_ = false;
+        if(haveRemote() && remote_->stop() < 0){
+            linkDown();
         }
+        MotionResult result;
+        result.completed = motion_reported_;
+        if(cancel && motion_server_->isActive()){
+            motion_server_->setPreempted(result, "Motion cancelled");
+        }
+    }else if(cancel && motion_server_->isActive()){
+        motion_server_->setPreempted(MotionResult(), "Motion cancelled");
+    }
+    if(!goal){
+        return;
+    }
 
-        /**
-         * @brief Get current odometry pose
-         * @return current odometry pose
-         */
-        Pose2D getPose(){
-            return pose_;
+    MotionResult result;
+    result.completed = 0;
+
+    //reject the whole goal up front, rather than leave part of it queued on the base
+    for(size_t i = 0; i < goal->primitives.size(); ++i){
+        const MotionPrimitive& primitive = goal->primitives[i];
+        std::ostringstream reason;
+        if(primitive.type == MotionPrimitive::MOVE){
+            if(!nav2protocol::canFormat(primitive.distance) ||
+               !nav2protocol::canFormat(nav2protocol::RadiansToDegrees::convert(primitive.direction))){
+                reason << "Motion primitive at index " << i << " is out of range";
+            }
+        }else if(primitive.type == MotionPrimitive::TURN){
+            if(!nav2protocol::canFormat(nav2protocol::RadiansToDegrees::convert(primitive.angle))){
+                reason << "Motion primitive at index " << i << " is out of range";
+            }
+        }else{
+            reason << "Unknown motion primitive type " << static_cast<int>(primitive.type) << " at index " << i;
+        }
+        if(!reason.str().empty()){
+            ROS_ERROR_STREAM(reason.str());
+            motion_server_->setAborted(result, reason.str());
+            return;
         }
+    }
+    if(!haveRemote()){
+        motion_server_->setAborted(result, "Not connected to Nav2 base");
+        return;
+    }
+    if(goal->primitives.empty()){
+        motion_server_->setSucceeded(result);
+        return;
+    }
 
-    private:
+    //queue every primitive in one write, unless the I/O thread is already collecting this iteration's commands
+    bool batch = !remote_->isBatching();
+    if(batch){
+        remote_->beginBatch();
+    }
+    motion_base_ = remote_->getQueuedMotions();
+    motion_count_ = goal->primitives.size();
+    motion_reported_ = 0;
+    int rc = 0;
+    for(size_t i = 0; i < goal->primitives.size() && rc == 0; ++i){
+        const MotionPrimitive& primitive = goal->primitives[i];
+        if(primitive.type == MotionPrimitive::MOVE){
+            rc = remote_->move(primitive.distance, primitive.direction);
+        }else{
+            rc = remote_->turnLeft(primitive.angle);
+        }
+    }
+    if(rc == 0){
+        remote_->whenIdle(boost::bind(&Nav2Driver::motionDone, this, motion_generation_, _1));
+        motion_active_ = true;
+
+        //the base runs the primitives on its own, without velocity commands to keep it going
+        if(watchdog_.isArmed()){
+            watchdog_.disarm();
+            armWatchdogTimer();
+        }
+    }
+    if(rc < 0 || (batch && remote_->commitBatch() < 0)){
+        linkDown();
+    }
 
-        Pose2D pose_, vel_, prev_, offset_;
-        ros::Time last_time_;
+}
 
-    };
+void Nav2Driver::motionDone(unsigned long generation, int rc){
 
-    ros::NodeHandle nh_;
-    ros::NodeHandle private_nh_;
-    tf::TransformBroadcaster tf_broadcaster_;
+    if(generation != motion_generation_ || !motion_active_){
+        return;
+    }
+    if(rc == 0){
+        motion_active_ = false;
+        MotionResult result;
+        result.completed = motion_count_;
+        motion_server_->setSucceeded(result);
+    }else if(rc > 0){
+        abortMotion("Motion queue cleared by a velocity command");
+    }else{
+        abortMotion("Lost connection to Nav2 base");
+    }
 
-    boost::shared_ptr<Nav2Remote> remote_;
+}
 
-    ros::Publisher odom_pub_;
-    ros::Subscriber cmd_sub_;
-    ros::Timer odom_loop_;
-    BaseOdometry base_odom_;
+void Nav2Driver::updateMotionFeedback(){
 
-    std::string robot_address_, robot_prefix_;
-    int robot_port_;
-    bool invert_odom_;
+    if(!motion_active_){
+        return;
+    }
+    unsigned long completed = std::min(remote_->getCompletedMotions() - motion_base_, motion_count_);
+    if(completed != motion_reported_){
+        motion_reported_ = completed;
+        MotionFeedback feedback;
+        feedback.completed = completed;
+        feedback.remaining = motion_count_ - completed;
+        motion_server_->publishFeedback(feedback);
+    }
 
-};
+}
+
+void Nav2Driver::abortMotion(const std::string& reason){
+
+    if(!motion_active_){
+        return;
+    }
+    motion_active_ = false;
+    ++motion_generation_;
+    MotionResult result;
+    result.completed = motion_reported_;
+    motion_server_->setAborted(result, reason);
 
 }
 
-int main(int argc, char **argv) {
+void Nav2Driver::reconfigure(Nav2DriverConfig& config, uint32_t level){
 
-    ros::init(argc, argv, "nav2_driver");
-    nav2_driver::Nav2Driver nav2_driver(ros::this_node::getName());
-    ros::spin();
+    //the timer only publishes snapshots in threaded or streaming mode, otherwise the next poll picks up the new rate
+    if((level & RECONFIGURE_POLL) && (io_thread_ || odom_stream_)){
+        PollScheduler scheduler(config.odom_rate, config.odom_rate_max, config.adaptive_odom);
+        odom_loop_.setPeriod(ros::Duration(scheduler.getMinPeriod()));
+    }
+
+    {
+        boost::mutex::scoped_lock lock(config_mutex_);
+        config_ = config;
+        config_level_ |= level;
+    }
+    config_ready_ = true;
+    if(io_thread_){
+        wake();
+    }else{
+        applyConfig();
+    }
 
-    return 0;
 }
 
+void Nav2Driver::applyConfig(){
 
+    if(config_ready_.exchange(false)){
+        Nav2DriverConfig config;
+        uint32_t level;
+        {
+            boost::mutex::scoped_lock lock(config_mutex_);
+            config = config_;
+            level = config_level_;
+            config_level_ = 0;
+        }
+        if(level & RECONFIGURE_POLL){
+            poll_scheduler_.setRates(config.odom_rate, config.odom_rate_max, config.adaptive_odom);
+            updateLinkStats();
+        }
+        if((level & RECONFIGURE_LIMITS) && (config.max_speed != max_speed_ || config.max_accel != max_accel_ ||
+                                            config.max_cornering_error != max_cornering_error_)){
+            max_speed_ = config.max_speed;
+            max_accel_ = config.max_accel;
+            max_cornering_error_ = config.max_cornering_error;
+            limits_dirty_ = true;
+        }
+    }
 
+    if(!limits_dirty_ || !haveRemote()){
+        return;
+    }
+
+    //send all limits in one write, or with the rest of the I/O thread's batch
+    bool batch = !remote_->isBatching();
+    if(batch){
+        remote_->beginBatch();
+    }
+    int rc = 0;
+    if(rc == 0 && max_speed_ >= 0.0){
+        rc = remote_->setMaxSpeed(max_speed_);
+    }
+    if(rc == 0 && max_accel_ >= 0.0){
+        rc = remote_->setMaxAccel(max_accel_);
+    }
+    if(rc == 0 && max_cornering_error_ >= 0.0){
+        rc = remote_->setMaxCorneringError(max_cornering_error_);
+    }
+    limits_dirty_ = false;
+    if(rc != 0 || (batch && remote_->commitBatch() < 0)){
+        linkDown();
+    }
+
+}
+
+void Nav2Driver::wake(){
+    uint64_t one = 1;
+    if(write(wake_fd_, &one, sizeof(one)) < 0) { /* counter saturated, thread is waking anyway */ }
+}
+
+void Nav2Driver::updateLinkStats(){
+    LinkStats stats;
+    stats.period = poll_scheduler_.getPeriod();
+    stats.round_trip = poll_scheduler_.getRoundTrip();
+    link_stats_.write(stats);
+}
+
+void Nav2Driver::updateDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat){
+
+    LinkStats link = link_stats_.read();
+
+    //latencies since the previous update only, so that they follow the link rather than its whole history
+    LatencyHistogram::Window rtt = rtt_hist_.take();
+    LatencyHistogram::Window odom_age = odom_age_hist_.take();
+    LatencyHistogram::Window odom_callback = odom_callback_hist_.take();
+    LatencyHistogram::Window cmd_callback = cmd_callback_hist_.take();
+    LatencyHistogram::Window watchdog = watchdog_hist_.take();
+
+    //flag a link that is down or cannot keep up with the poll rate
+    if(!link_up_){
+        stat.summary(diagnostic_msgs::DiagnosticStatus::ERROR, "Disconnected");
+    }else if(rtt_hist_.getTotal() == 0){
+        stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "No odometry received yet");
+    }else if(rtt.getCount() == 0){
+        stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "No odometry received since the last update");
+    }else if(rtt.getPercentile(0.9) > link.period){
+        stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Round trip time exceeds odometry period");
+    }else{
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Connected");
+    }
+
+    stat.addf("Odometry period (ms)", "%.1f", link.period * 1e3);
+    stat.addf("Round trip p50 (ms)", "%.2f", rtt.getPercentile(0.5) * 1e3);
+    stat.addf("Round trip p90 (ms)", "%.2f", rtt.getPercentile(0.9) * 1e3);
+    stat.addf("Round trip p99 (ms)", "%.2f", rtt.getPercentile(0.99) * 1e3);
+    stat.addf("Round trip max (ms)", "%.2f", rtt.getMax() * 1e3);
+    stat.addf("One way latency estimate (ms)", "%.2f", link.round_trip * 0.5e3);
+    stat.addf("Odometry age p99 (ms)", "%.2f", odom_age.getPercentile(0.99) * 1e3);
+    stat.addf("Odometry callback p99 (ms)", "%.2f", odom_callback.getPercentile(0.99) * 1e3);
+    stat.addf("cmd_vel callback p99 (ms)", "%.2f", cmd_callback.getPercentile(0.99) * 1e3);
+    stat.add("Odometry polls", rtt_hist_.getTotal());
+    stat.add("Velocity commands sent", cmd_sent_.load());
+    stat.add("Velocity commands coalesced", cmd_coalesced_.load());
+    stat.add("Velocity commands unchanged", cmd_skipped_.load());
+    stat.add("Velocity transport", socket_options_.velocityPort > 0 ? "UDP" : "TCP");
+    if(watchdog_.isEnabled()){
+        stat.addf("Command timeout (s)", "%.2f", watchdog_.getTimeout());
+        stat.add("Watchdog stops", watchdog_hist_.getTotal());
+        stat.addf("Watchdog stop latency p99 (ms)", "%.2f", watchdog.getPercentile(0.99) * 1e3);
+        stat.addf("Watchdog stop latency max (ms)", "%.2f", watchdog.getMax() * 1e3);
+    }
+    stat.add("Unchanged transforms skipped", tf_skipped_.load());
+    stat.add("Poll overruns", poll_overruns_.load());
+    stat.add("Reconnects", reconnects_.load());
+    stat.add("Failed connection attempts", connect_failures_.load());
+    if(traffic_log_){
+        stat.add("Traffic log bytes", traffic_log_->getWritten());
+        stat.add("Traffic log records dropped", traffic_log_->getDropped());
+    }
+
+}
+
+void Nav2Driver::publishDiagnostics(const ros::TimerEvent&){
+    diagnostics_.update();
+}
+
+}
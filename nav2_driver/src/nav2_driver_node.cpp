@@ -0,0 +1,23 @@
+#include <ros/ros.h>
+
+#include <nav2_driver/nav2_driver.h>
+
+int main(int argc, char **argv) {
+
+    ros::init(argc, argv, "nav2_driver");
+    ros::NodeHandle private_nh("~");
+    nav2_driver::Nav2Driver nav2_driver(ros::NodeHandle(), private_nh);
+
+    //several spinner threads let the odometry, cmd_vel and diagnostics callbacks run in parallel
+    int spinner_threads;
+    private_nh.param<int>("spinner_threads", spinner_threads, 1);
+    if(spinner_threads > 1){
+        ros::AsyncSpinner spinner(spinner_threads);
+        spinner.start();
+        ros::waitForShutdown();
+    }else{
+        ros::spin();
+    }
+
+    return 0;
+}
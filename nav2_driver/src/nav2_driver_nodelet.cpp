@@ -0,0 +1,46 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include <nav2_driver/nav2_driver.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <exception>
+
+namespace nav2_driver{
+
+/**
+ * @brief Nodelet wrapper for Nav2Driver, so odometry can be passed to consumers in the same nodelet manager without
+ * serialization
+ */
+class Nav2DriverNodelet : public nodelet::Nodelet{
+
+public:
+
+    virtual void onInit(){
+        //single threaded handles unless spinner_threads is set, in which case the driver keeps the socket on its I/O
+        //thread and the callbacks may run on the manager's worker threads
+        int spinner_threads;
+        getPrivateNodeHandle().param<int>("spinner_threads", spinner_threads, 1);
+
+        //a bad parameter or unreachable base must not take down the whole manager, and the other nodelets with it
+        try{
+            if(spinner_threads > 1){
+                driver_.reset(new Nav2Driver(getMTNodeHandle(), getMTPrivateNodeHandle()));
+            }else{
+                driver_.reset(new Nav2Driver(getNodeHandle(), getPrivateNodeHandle()));
+            }
+        }catch(std::exception& e){
+            NODELET_FATAL_STREAM("Failed to start Nav2 driver: " << e.what());
+        }
+    }
+
+private:
+
+    boost::shared_ptr<Nav2Driver> driver_;
+
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(nav2_driver::Nav2DriverNodelet, nodelet::Nodelet)
@@ -0,0 +1,535 @@
+#include <nav2_driver/nav2_fleet_driver.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+#include <cstdlib>
+#include <ctime>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace nav2_driver{
+
+namespace{
+
+//epoll data for the wakeup descriptor, robots use their index + 1
+const uint64_t WAKE_EVENT = 0;
+
+}
+
+Nav2FleetDriver::Nav2FleetDriver(ros::NodeHandle nh, ros::NodeHandle private_nh) :
+    nh_(nh),
+    private_nh_(private_nh),
+    io_running_(false),
+    epoll_fd_(-1),
+    wake_fd_(-1),
+    reconnect_running_(true),
+    reconnects_(0),
+    connect_failures_(0),
+    poll_overruns_(0),
+    diagnostics_(nh, private_nh)
+{
+
+    //get parameters shared by all robots, named as for Nav2Driver
+    private_nh_.param<bool>("invert_odom", invert_odom_, false);
+    private_nh_.param<bool>("publish_base_link", publish_base_link_, false);
+    private_nh_.param<bool>("tf_skip_unchanged", tf_skip_unchanged_, true);
+    private_nh_.param<double>("tf_keepalive", tf_keepalive_, 0.1);
+    private_nh_.param<double>("odom_rate", odom_rate_, 10.0);
+    if(odom_rate_ <= 0.0){
+        std::string message = "Odometry rate must be positive";
+        ROS_ERROR_STREAM(message);
+        throw std::runtime_error(message);
+    }
+
+    std::string velocity_filter;
+    int velocity_window;
+    double velocity_alpha, velocity_beta;
+    private_nh_.param<std::string>("velocity_filter", velocity_filter, "least_squares");
+    private_nh_.param<int>("velocity_window", velocity_window, 5);
+    private_nh_.param<double>("velocity_alpha", velocity_alpha, 0.5);
+    private_nh_.param<double>("velocity_beta", velocity_beta, 0.1);
+    VelocityEstimator::Method velocity_method;
+    if(!VelocityEstimator::parseMethod(velocity_filter, velocity_method)){
+        std::string message = "Unknown velocity_filter " + velocity_filter +
+                              ", use difference, least_squares or alpha_beta";
+        ROS_ERROR_STREAM(message);
+        throw std::runtime_error(message);
+    }
+    velocity_estimator_ = VelocityEstimator(velocity_method, velocity_window, velocity_alpha, velocity_beta);
+
+    //get pose and twist covariance, each as 6 diagonal or 36 row-major values, shared by all robots
+    private_nh_.param<bool>("adaptive_twist_covariance", odom_covariance_.adaptive_twist, false);
+    if(!OdometryCovariance::load(private_nh_, "pose_covariance", odom_covariance_.pose) ||
+       !OdometryCovariance::load(private_nh_, "twist_covariance", odom_covariance_.twist)){
+        std::string message = "Covariance parameters need 6 diagonal or 36 row-major numbers, "
+                              "with a non-negative diagonal";
+        ROS_ERROR_STREAM(message);
+        throw std::runtime_error(message);
+    }
+
+    private_nh_.param<double>("cmd_rate_max", cmd_rate_max_, 20.0);
+    private_nh_.param<double>("cmd_epsilon", cmd_epsilon_, 1e-3);
+    private_nh_.param<double>("cmd_keepalive", cmd_keepalive_, 0.5);
+
+    private_nh_.param<double>("connect_timeout", connect_timeout_, 1.0);
+    private_nh_.param<double>("reconnect_backoff_min", backoff_min_, 0.2);
+    private_nh_.param<double>("reconnect_backoff_max", backoff_max_, 5.0);
+
+    private_nh_.param<bool>("tcp_nodelay", socket_options_.noDelay, true);
+    private_nh_.param<bool>("tcp_keepalive", socket_options_.keepAlive, true);
+    private_nh_.param<int>("tcp_keepalive_idle", socket_options_.keepAliveIdle, 2);
+    private_nh_.param<int>("tcp_keepalive_interval", socket_options_.keepAliveInterval, 1);
+    private_nh_.param<int>("tcp_keepalive_count", socket_options_.keepAliveCount, 3);
+    private_nh_.param<int>("socket_priority", socket_options_.priority, -1);
+    private_nh_.param<int>("socket_tos", socket_options_.tos, -1);
+    private_nh_.param<bool>("socket_timestamps", socket_options_.timestamps, true);
+    private_nh_.param<int>("velocity_udp_port", socket_options_.velocityPort, 0);
+
+    //one traffic log for all robots, records carry the robot index as their channel
+    std::string traffic_log;
+    bool traffic_log_mmap;
+    int traffic_log_buffer;
+    private_nh_.param<std::string>("traffic_log", traffic_log, "");
+    private_nh_.param<bool>("traffic_log_mmap", traffic_log_mmap, false);
+    private_nh_.param<int>("traffic_log_buffer", traffic_log_buffer, 1 << 20);
+    if(!traffic_log.empty()){
+        try{
+            traffic_log_.reset(new TrafficLog(traffic_log, traffic_log_buffer, traffic_log_mmap));
+        }catch(std::exception& e){
+            std::string message = std::string(e.what()) + ": " + traffic_log;
+            ROS_ERROR_STREAM(message);
+            throw std::runtime_error(message);
+        }
+    }
+
+    //create the wakeup descriptor first, cmd_vel callbacks use it as soon as they are subscribed
+    epoll_fd_ = epoll_create1(0);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_EVENT;
+    if(epoll_fd_ < 0 || wake_fd_ < 0 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) < 0){
+        std::string message = "Failed to create fleet I/O thread descriptors";
+        ROS_ERROR_STREAM(message);
+        throw std::runtime_error(message);
+    }
+
+    loadRobots();
+
+    //one timer publishes every robot's snapshot, the I/O thread polls each robot at odom_rate
+    odom_loop_ = nh_.createTimer(ros::Duration(1.0 / odom_rate_), &Nav2FleetDriver::publishOdometry, this);
+
+    diagnostics_.setHardwareID("nav2_fleet");
+    diagnostics_.add("Nav2 fleet links", this, &Nav2FleetDriver::updateDiagnostics);
+    diagnostics_timer_ = nh_.createTimer(ros::Duration(1.0), &Nav2FleetDriver::publishDiagnostics, this);
+
+    reconnect_thread_ = boost::thread(&Nav2FleetDriver::reconnectLoop, this);
+    io_running_ = true;
+    io_thread_ = boost::thread(&Nav2FleetDriver::ioLoop, this);
+
+}
+
+Nav2FleetDriver::~Nav2FleetDriver(){
+    if(io_thread_.joinable()){
+        io_running_ = false;
+        wake();
+        io_thread_.join();
+    }
+    {
+        boost::mutex::scoped_lock lock(link_mutex_);
+        reconnect_running_ = false;
+        link_cond_.notify_all();
+    }
+    if(reconnect_thread_.joinable()){
+        reconnect_thread_.join();
+    }
+    if(wake_fd_ >= 0){
+        close(wake_fd_);
+    }
+    if(epoll_fd_ >= 0){
+        close(epoll_fd_);
+    }
+}
+
+void Nav2FleetDriver::loadRobots(){
+
+    XmlRpc::XmlRpcValue robots;
+    if(!private_nh_.getParam("robots", robots) || robots.getType() != XmlRpc::XmlRpcValue::TypeArray ||
+       robots.size() == 0){
+        std::string message = "Please provide a list of robots, each with a name and an address";
+        ROS_ERROR_STREAM(message);
+        throw std::runtime_error(message);
+    }
+
+    for(int i = 0; i < robots.size(); ++i){
+        XmlRpc::XmlRpcValue& entry = robots[i];
+        if(entry.getType() != XmlRpc::XmlRpcValue::TypeStruct || !entry.hasMember("name") ||
+           !entry.hasMember("address")){
+            std::string message = "Each robot needs a name and an address";
+            ROS_ERROR_STREAM(message);
+            throw std::runtime_error(message);
+        }
+
+        boost::shared_ptr<Robot> robot(new Robot());
+        robot->index = robots_.size();
+        robot->name = static_cast<std::string>(entry["name"]);
+        robot->address = static_cast<std::string>(entry["address"]);
+        if(entry.hasMember("port")){
+            robot->port = static_cast<int>(entry["port"]);
+        }
+
+        //same topics and frames as a Nav2Driver with robot_name set, pushed into the robot's namespace
+        nav_msgs::Odometry odom_template;
+        robot->odom_transform = TransformCache(tf_skip_unchanged_, tf_keepalive_);
+        initOdometryMessages(robot->name + "_", invert_odom_, odom_covariance_, odom_template,
+                             robot->odom_transform.getTransform());
+        robot->odom_pool = MessagePool<nav_msgs::Odometry>(odom_template);
+        robot->odom = BaseOdometry(Pose2D(), velocity_estimator_);
+        robot->poll_scheduler = PollScheduler(odom_rate_);
+        robot->cmd_coalescer = CommandCoalescer<VelocityCommand>(cmd_rate_max_, cmd_epsilon_, cmd_keepalive_);
+        robot->backoff = backoff_min_;
+
+        ros::NodeHandle robot_nh(nh_, robot->name);
+        robot->odom_pub = robot_nh.advertise<nav_msgs::Odometry>("odom", 10);
+        boost::function<void (const geometry_msgs::TwistConstPtr&)> callback =
+            boost::bind(&Nav2FleetDriver::setVelocity, this, _1, robot.get());
+        robot->cmd_sub = robot_nh.subscribe<geometry_msgs::Twist>("cmd_vel", 1, callback);
+
+        robots_.push_back(robot);
+        ROS_INFO_STREAM("Fleet robot " << robot->name << " at " << robot->address << ":" << robot->port);
+    }
+
+    //start with a slot for every robot, so that recycled messages keep their frame ids while all robots move
+    tf2_msgs::TFMessage tf_template;
+    for(size_t i = 0; i < robots_.size(); ++i){
+        tf_template.transforms.push_back(robots_[i]->odom_transform.getTransform());
+    }
+    tf_pool_ = MessagePool<tf2_msgs::TFMessage>(tf_template);
+    tf_pub_ = nh_.advertise<tf2_msgs::TFMessage>("/tf", 100);
+
+    //every robot's fixed base_link frame, latched together in one static tf message
+    if(publish_base_link_){
+        std::vector<geometry_msgs::TransformStamped> base_links(robots_.size());
+        for(size_t i = 0; i < robots_.size(); ++i){
+            initStaticTransform(robots_[i]->name + "_", base_links[i]);
+        }
+        static_broadcaster_.sendTransform(base_links);
+    }
+
+}
+
+void Nav2FleetDriver::setVelocity(const geometry_msgs::TwistConstPtr& twist, Robot* robot){
+
+    VelocityCommand command;
+    command.vx = twist->linear.x;
+    command.vy = twist->linear.y;
+    command.wz = twist->angular.z;
+    if(!command.isValid()){
+        ROS_ERROR_THROTTLE(1.0, "Ignoring velocity command with components out of range for %s", robot->name.c_str());
+        return;
+    }
+
+    robot->cmd_mailbox.write(command);
+    robot->cmd_ready = true;
+    wake();
+
+}
+
+void Nav2FleetDriver::publishOdometry(const ros::TimerEvent&){
+
+    //all robots' transforms go out as one tf message
+    tf2_msgs::TFMessagePtr transforms = tf_pool_.next();
+    size_t count = 0;
+    for(size_t i = 0; i < robots_.size(); ++i){
+        Robot& robot = *robots_[i];
+        if(!robot.odom_snapshot.read(robot.published)){
+            continue;
+        }
+
+        if(robot.odom_transform.update(robot.published, invert_odom_)){
+            if(count == transforms->transforms.size()){
+                transforms->transforms.push_back(geometry_msgs::TransformStamped());
+            }
+            robot.odom_transform.copyTo(transforms->transforms[count++]);
+        }
+
+        nav_msgs::OdometryPtr message = robot.odom_pool.next();
+        robot.published.fillMessage(*message);
+        if(odom_covariance_.adaptive_twist){
+            robot.published.fillTwistCovariance(odom_covariance_.twist, *message);
+        }
+        robot.odom_pub.publish(nav_msgs::OdometryConstPtr(message));
+    }
+    if(count > 0){
+        transforms->transforms.resize(count);
+        tf_pub_.publish(tf2_msgs::TFMessageConstPtr(transforms));
+    }
+
+}
+
+bool Nav2FleetDriver::haveRemote(Robot& robot){
+
+    if(robot.remote){
+        return true;
+    }
+    if(!robot.remote_pending.load(boost::memory_order_acquire)){
+        return false;
+    }
+
+    {
+        boost::mutex::scoped_lock lock(link_mutex_);
+        robot.remote.swap(robot.pending_remote);
+        robot.remote_pending = false;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = robot.index + 1;
+    if(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, robot.remote->getFd(), &event) < 0){
+        ROS_ERROR_STREAM("Failed to watch connection to " << robot.name);
+        robot.remote.reset();
+        linkDown(robot);
+        return false;
+    }
+    robot.next_poll = ros::WallTime::now().toSec();
+    return true;
+
+}
+
+void Nav2FleetDriver::linkDown(Robot& robot){
+
+    if(robot.remote){
+        ROS_WARN_STREAM("Lost connection to " << robot.name << ", reconnecting");
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, robot.remote->getFd(), NULL);
+        robot.remote.reset();
+        robot.cmd_coalescer.reset();
+        ++reconnects_;
+
+        //save odometry offset for new base connection odometry
+        Pose2D offset = robot.odom.getOffsetPose();
+        robot.odom = BaseOdometry(offset, velocity_estimator_);
+    }
+    robot.link_up = false;
+
+    boost::mutex::scoped_lock lock(link_mutex_);
+    robot.reconnect_requested = true;
+    robot.next_attempt = ros::WallTime::now().toSec();
+    link_cond_.notify_all();
+
+}
+
+void Nav2FleetDriver::reconnectLoop(){
+
+    unsigned int seed = time(NULL) ^ (getpid() << 16);
+
+    boost::mutex::scoped_lock lock(link_mutex_);
+    while(reconnect_running_){
+
+        //pick the robot whose next attempt is due first
+        Robot* robot = NULL;
+        for(size_t i = 0; i < robots_.size(); ++i){
+            Robot* candidate = robots_[i].get();
+            if(candidate->reconnect_requested && (!robot || candidate->next_attempt < robot->next_attempt)){
+                robot = candidate;
+            }
+        }
+        if(!robot){
+            link_cond_.wait(lock);
+            continue;
+        }
+        double now = ros::WallTime::now().toSec();
+        if(robot->next_attempt > now){
+            boost::system_time deadline = boost::get_system_time() +
+                                          boost::posix_time::microseconds((long)((robot->next_attempt - now) * 1e6));
+            link_cond_.timed_wait(lock, deadline);
+            continue;
+        }
+
+        //connect without holding the lock, the I/O thread may be checking for new connections meanwhile
+        lock.unlock();
+        boost::shared_ptr<Nav2Remote> remote;
+        try{
+            remote = boost::shared_ptr<Nav2Remote>(new Nav2Remote(robot->address.c_str(), robot->port,
+                                                                  connect_timeout_, socket_options_));
+            remote->setTrafficLog(traffic_log_.get(), robot->index);
+        }catch(std::exception& e){
+            ROS_WARN_STREAM_THROTTLE(5.0, "Failed to connect to " << robot->name << " on " << robot->address << ":"
+                                     << robot->port << ": " << e.what());
+            ++connect_failures_;
+        }
+        lock.lock();
+
+        if(remote){
+            ROS_INFO_STREAM("Connected to " << robot->name << " on " << robot->address << ":" << robot->port);
+            robot->pending_remote = remote;
+            robot->remote_pending = true;
+            robot->link_up = true;
+            robot->reconnect_requested = false;
+            robot->backoff = backoff_min_;
+            wake();
+        }else{
+            //back off exponentially, with jitter so robots do not retry in lockstep
+            const double jitter = 0.25;
+            robot->next_attempt = ros::WallTime::now().toSec() +
+                                  robot->backoff * (1.0 + jitter * (2.0 * rand_r(&seed) / RAND_MAX - 1.0));
+            robot->backoff = std::min(robot->backoff * 2.0, backoff_max_);
+        }
+
+    }
+
+}
+
+void Nav2FleetDriver::ioLoop(){
+
+    const int MAX_EVENTS = 64;
+    struct epoll_event events[MAX_EVENTS];
+
+    while(io_running_){
+
+        //sleep until a command, a reply, a new connection, or the next poll or command of any robot is due
+        double due = std::numeric_limits<double>::max();
+        for(size_t i = 0; i < robots_.size(); ++i){
+            Robot& robot = *robots_[i];
+            if(robot.remote){
+                due = std::min(due, std::min(robot.next_poll, robot.cmd_coalescer.getNextDue()));
+            }
+        }
+        double wait = due - ros::WallTime::now().toSec();
+        int timeout = due == std::numeric_limits<double>::max() ? -1 : (int)std::max(0.0, wait * 1000.0);
+        int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout);
+
+        //dispatch replies and drain anything else a base sent, as the fds are level triggered and one readable socket
+        //would otherwise spin the loop for the whole fleet. Reconnect in background on error, or once a base hangs up
+        for(int i = 0; i < count; ++i){
+            if(events[i].data.u64 == WAKE_EVENT){
+                uint64_t value;
+                if(read(wake_fd_, &value, sizeof(value)) < 0) { /* already drained */ }
+                continue;
+            }
+            Robot& robot = *robots_[events[i].data.u64 - 1];
+            if(robot.remote && robot.remote->processReplies() < 0){
+                linkDown(robot);
+            }
+        }
+
+        double now = ros::WallTime::now().toSec();
+        for(size_t i = 0; i < robots_.size(); ++i){
+            Robot& robot = *robots_[i];
+            bool connected = haveRemote(robot);
+
+            VelocityCommand command;
+            if(robot.cmd_ready.exchange(false) && robot.cmd_mailbox.read(command)){
+                if(connected){
+                    robot.cmd_coalescer.offer(command);
+                }else{
+                    ROS_WARN_STREAM_THROTTLE(1.0, "Not connected to " << robot.name << ", dropping velocity command");
+                }
+            }
+            if(!connected){
+                continue;
+            }
+
+            //a velocity command and a position query due together share one write
+            robot.remote->beginBatch();
+            if(robot.cmd_coalescer.poll(now, command) && command.send(*robot.remote) < 0){
+                linkDown(robot);
+                continue;
+            }
+            if(now >= robot.next_poll){
+                bool overrun = robot.remote->getPendingReplies() != 0;
+                if(!overrun && robot.remote->estimatePositionAsync(boost::bind(&Nav2FleetDriver::handlePosition, this,
+                                                                                &robot, _1, _2, _3, _4)) < 0){
+                    linkDown(robot);
+                    continue;
+                }
+
+                //schedule from the deadline this poll was due at, so that a late poll is an overrun too
+                unsigned long overruns = robot.poll_scheduler.getOverruns();
+                robot.next_poll = robot.poll_scheduler.next(robot.next_poll, now);
+                if(overrun || robot.poll_scheduler.getOverruns() != overruns){
+                    ++poll_overruns_;
+                }
+            }
+            if(robot.remote->commitBatch() < 0){
+                linkDown(robot);
+            }
+        }
+    }
+
+}
+
+void Nav2FleetDriver::handlePosition(Robot* robot, int rc, double x, double y, double th){
+
+    if(rc < 0){
+        return;
+    }
+
+    //stamp half a smoothed round trip before the reply arrived, as Nav2Driver does
+    double received = robot->remote->getReplyTime();
+    double rtt = received - robot->remote->getQueryTime();
+    robot->poll_scheduler.addRoundTrip(rtt);
+    robot->rtt_hist.record(rtt);
+    double age = ros::WallTime::now().toSec() - received + 0.5 * robot->poll_scheduler.getRoundTrip();
+    ros::Time stamp = ros::Time::now() - ros::Duration(std::max(age, 0.0));
+
+    robot->odom.updateWithAbsolute(Pose2D(x, y, th), stamp);
+    robot->odom_snapshot.write(robot->odom);
+
+}
+
+void Nav2FleetDriver::wake(){
+    uint64_t one = 1;
+    if(write(wake_fd_, &one, sizeof(one)) < 0) { /* counter saturated, thread is waking anyway */ }
+}
+
+void Nav2FleetDriver::updateDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat){
+
+    size_t connected = 0;
+    unsigned long tf_skipped = 0;
+    for(size_t i = 0; i < robots_.size(); ++i){
+        Robot& robot = *robots_[i];
+        tf_skipped += robot.odom_transform.getSkipped();
+        //round trips since the previous update only, so that they follow the link rather than its whole history
+        LatencyHistogram::Window rtt = robot.rtt_hist.take();
+        if(robot.link_up){
+            ++connected;
+            std::ostringstream value;
+            value.precision(2);
+            value << std::fixed << "connected, round trip p50 " << rtt.getPercentile(0.5) * 1e3
+                  << " ms, p99 " << rtt.getPercentile(0.99) * 1e3 << " ms";
+            stat.add(robot.name, value.str());
+        }else{
+            stat.add(robot.name, "disconnected");
+        }
+    }
+
+    if(connected == robots_.size()){
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "All robots connected");
+    }else if(connected > 0){
+        stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "%lu of %lu robots connected",
+                      (unsigned long)connected, (unsigned long)robots_.size());
+    }else{
+        stat.summary(diagnostic_msgs::DiagnosticStatus::ERROR, "No robots connected");
+    }
+    stat.add("Unchanged transforms skipped", tf_skipped);
+    stat.add("Poll overruns", poll_overruns_.load());
+    stat.add("Reconnects", reconnects_.load());
+    stat.add("Failed connection attempts", connect_failures_.load());
+    if(traffic_log_){
+        stat.add("Traffic log bytes", traffic_log_->getWritten());
+        stat.add("Traffic log records dropped", traffic_log_->getDropped());
+    }
+
+}
+
+void Nav2FleetDriver::publishDiagnostics(const ros::TimerEvent&){
+    diagnostics_.update();
+}
+
+}
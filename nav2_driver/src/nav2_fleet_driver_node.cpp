@@ -0,0 +1,12 @@
+#include <ros/ros.h>
+
+#include <nav2_driver/nav2_fleet_driver.h>
+
+int main(int argc, char **argv) {
+
+    ros::init(argc, argv, "nav2_fleet_driver");
+    nav2_driver::Nav2FleetDriver nav2_fleet_driver(ros::NodeHandle(), ros::NodeHandle("~"));
+    ros::spin();
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <ros/ros.h>
+#include <nav_msgs/Odometry.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <tf/transform_broadcaster.h>
+
+#include <nav2_driver/traffic_log.h>
+#include <nav2_driver/nav2protocol.h>
+#include <nav2_driver/base_odometry.h>
+#include <nav2_driver/velocity_estimator.h>
+#include <nav2_driver/message_pool.h>
+#include <nav2_driver/transform_cache.h>
+
+#include <deque>
+#include <string>
+#include <cstring>
+
+using namespace nav2_driver;
+
+namespace{
+
+enum QueryKind { POSITION_QUERY, VALUE_QUERY };
+
+/**
+ * @brief Remember the replies expected for the queries in a sent record, which may hold several batched lines
+ */
+void queueQueries(const TrafficLogReader::Record& record, std::deque<QueryKind>& expected){
+    const char* end = record.data + record.length;
+    for(const char* p = record.data; p < end;){
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if(eol == NULL){
+            eol = end;
+        }
+        if(eol - p == 1 && p[0] == 'q'){
+            expected.push_back(POSITION_QUERY);
+        }else if(eol > p && p[0] == 'q'){
+            expected.push_back(VALUE_QUERY);
+        }
+        p = eol + 1;
+    }
+}
+
+}
+
+/**
+ * Replays a traffic log recorded by nav2_driver through odometry and its publishers, eg for offline benchmarking.
+ * Position replies are matched to their queries and published stamped with the time they were received.
+ */
+int main(int argc, char **argv) {
+
+    ros::init(argc, argv, "nav2_replay");
+    ros::NodeHandle nh, private_nh("~");
+
+    //get log file, and which connection in it to replay
+    std::string path;
+    int channel;
+    private_nh.param<std::string>("log", path, "");
+    private_nh.param<int>("channel", channel, 0);
+    if(path.empty()){
+        ROS_ERROR("Please provide a traffic log to replay");
+        return 1;
+    }
+
+    //get replay speed relative to the recording, as fast as possible if 0, and whether to repeat the log
+    double speed;
+    bool loop;
+    private_nh.param<double>("speed", speed, 0.0);
+    private_nh.param<bool>("loop", loop, false);
+
+    //get the same odometry parameters as the driver
+    std::string robot_name, robot_prefix, velocity_filter;
+    bool invert_odom;
+    int velocity_window;
+    double velocity_alpha, velocity_beta;
+    private_nh.param<std::string>("robot_name", robot_name, "");
+    if (!robot_name.empty()) { robot_prefix = robot_name + "_"; }
+    private_nh.param<bool>("invert_odom", invert_odom, false);
+    private_nh.param<std::string>("velocity_filter", velocity_filter, "least_squares");
+    private_nh.param<int>("velocity_window", velocity_window, 5);
+    private_nh.param<double>("velocity_alpha", velocity_alpha, 0.5);
+    private_nh.param<double>("velocity_beta", velocity_beta, 0.1);
+    VelocityEstimator::Method velocity_method;
+    if(!VelocityEstimator::parseMethod(velocity_filter, velocity_method)){
+        ROS_ERROR_STREAM("Unknown velocity_filter " + velocity_filter);
+        return 1;
+    }
+    VelocityEstimator velocity_estimator(velocity_method, velocity_window, velocity_alpha, velocity_beta);
+    OdometryCovariance odom_covariance;
+    private_nh.param<bool>("adaptive_twist_covariance", odom_covariance.adaptive_twist, false);
+    if(!OdometryCovariance::load(private_nh, "pose_covariance", odom_covariance.pose) ||
+       !OdometryCovariance::load(private_nh, "twist_covariance", odom_covariance.twist)){
+        ROS_ERROR_STREAM("Covariance parameters need 6 diagonal or 36 row-major numbers, with a non-negative diagonal");
+        return 1;
+    }
+
+    boost::shared_ptr<TrafficLogReader> reader;
+    try{
+        reader.reset(new TrafficLogReader(path));
+    }catch(std::exception& e){
+        ROS_ERROR_STREAM(e.what() << ": " << path);
+        return 1;
+    }
+
+    ros::Publisher odom_pub = nh.advertise<nav_msgs::Odometry>("odom", 10);
+    tf::TransformBroadcaster tf_broadcaster;
+    nav_msgs::Odometry odom_message;
+    TransformCache odom_transform;
+    initOdometryMessages(robot_prefix, invert_odom, odom_covariance, odom_message, odom_transform.getTransform());
+    MessagePool<nav_msgs::Odometry> odom_pool(odom_message);
+
+    do{
+        BaseOdometry odom(Pose2D(), velocity_estimator);
+        std::deque<QueryKind> expected;
+        unsigned long records = 0, samples = 0;
+        uint64_t first_time = 0;
+        ros::WallTime start = ros::WallTime::now();
+
+        TrafficLogReader::Record record;
+        reader->rewind();
+        while(ros::ok() && reader->next(record)){
+            if(record.channel != (unsigned int)channel){
+                continue;
+            }
+            ++records;
+
+            //keep the recorded pace, scaled by speed
+            if(first_time == 0){
+                first_time = record.time;
+            }
+            if(speed > 0.0){
+                ros::WallTime due = start + ros::WallDuration((record.time - first_time) * 1e-9 / speed);
+                ros::WallTime now = ros::WallTime::now();
+                if(due > now){
+                    (due - now).sleep();
+                }
+            }
+
+            if(record.direction == TrafficLog::SENT){
+                queueQueries(record, expected);
+                continue;
+            }
+
+            //ignore status lines, and replies to queries sent before the log started
+            if(record.length == 0 || record.data[0] == '|' || record.data[0] == '+' || expected.empty()){
+                continue;
+            }
+            QueryKind kind = expected.front();
+            expected.pop_front();
+            if(kind != POSITION_QUERY){
+                continue;
+            }
+
+            std::string line(record.data, record.length);
+            double x = 0, y = 0, th = 0;
+            int qlen = 0;
+            nav2protocol::parsePosition(line.c_str(), x, y, th, qlen);
+
+            ros::Time stamp;
+            stamp.fromNSec(record.time + reader->getRealtimeOffset());
+            odom.updateWithAbsolute(Pose2D(x, y, th), stamp);
+            ++samples;
+
+            if(odom_transform.update(odom, invert_odom)){
+                tf_broadcaster.sendTransform(odom_transform.getTransform());
+            }
+            nav_msgs::OdometryPtr message = odom_pool.next();
+            odom.fillMessage(*message);
+            if(odom_covariance.adaptive_twist){
+                odom.fillTwistCovariance(odom_covariance.twist, *message);
+            }
+            odom_pub.publish(nav_msgs::OdometryConstPtr(message));
+        }
+
+        double elapsed = (ros::WallTime::now() - start).toSec();
+        ROS_INFO("Replayed %lu records, %lu position samples in %.3f s, %.0f samples/s", records, samples, elapsed,
+                 elapsed > 0.0 ? samples / elapsed : 0.0);
+    }while(loop && ros::ok());
+
+    return 0;
+}
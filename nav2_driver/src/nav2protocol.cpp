@@ -0,0 +1,149 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include <nav2_driver/nav2protocol.h>
+
+namespace
+{
+
+// Powers of ten that are exactly representable as doubles.
+const double exactPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isSpace( char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+inline bool isDigit( char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+const char* slowParseDouble( const char* str, double& value)
+{
+    char* end;
+    double result = strtod(str, &end);
+    if( end == str) return NULL;
+    value = result;
+    return end;
+}
+
+}
+
+namespace nav2protocol
+{
+
+int formatDouble( char* buf, double value)
+{
+    if( !canFormat(value)) return -1;
+
+    // Below 1e6 the scaled value carries enough spare precision to tell
+    // which way the sixth decimal rounds, except within a hair of a tie.
+    double a = fabs(value);
+    if( !(a < 1e6)) return sprintf(buf, "%lf", value);
+
+    double scaled = a * 1e6;
+    double whole = floor(scaled);
+    double frac = scaled - whole;
+    if( fabs(frac - 0.5) < 1e-3) return sprintf(buf, "%lf", value);
+
+    unsigned long long n = (unsigned long long)whole + (frac > 0.5 ? 1 : 0);
+    unsigned long long ipart = n / 1000000;
+    unsigned long fpart = n % 1000000;
+
+    char* p = buf;
+    // sprintf keeps the sign of negative zero and of tiny negatives.
+    if( value < 0 || (value == 0 && 1.0 / value < 0)) *p++ = '-';
+
+    char digits[20];
+    int len = 0;
+    do {
+        digits[len++] = '0' + ipart % 10;
+        ipart /= 10;
+    } while( ipart);
+    while( len) *p++ = digits[--len];
+
+    *p++ = '.';
+    for( int i = 5; i >= 0; --i) {
+        p[i] = '0' + fpart % 10;
+        fpart /= 10;
+    }
+    p += 6;
+    *p = 0;
+
+    return p - buf;
+}
+
+int formatUnsigned( char* buf, unsigned int value)
+{
+    char digits[MAX_UNSIGNED_LENGTH];
+    int len = 0;
+    do {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while( value);
+    for( int i = 0; i < len; ++i) buf[i] = digits[len - 1 - i];
+    return len;
+}
+
+const char* parseDouble( const char* str, double& value)
+{
+    const char* p = str;
+    while( isSpace(*p)) ++p;
+
+    bool negative = false;
+    if( *p == '-' || *p == '+') negative = (*p++ == '-');
+
+    // Plain decimal numbers only; anything fancier goes to strtod().
+    if( !isDigit(*p) && !(*p == '.' && isDigit(p[1])))
+        return slowParseDouble(str, value);
+
+    unsigned long long mantissa = 0;
+    int digits = 0, decimals = 0;
+    for( ; isDigit(*p); ++p, ++digits) mantissa = mantissa * 10 + (*p - '0');
+    if( *p == '.') {
+        for( ++p; isDigit(*p); ++p, ++digits, ++decimals)
+            mantissa = mantissa * 10 + (*p - '0');
+    }
+
+    // Exact mantissa divided by an exact power of ten rounds correctly,
+    // which is what strtod() would return.
+    if( digits > 19 || mantissa >= (1ULL << 53) || decimals > 22 ||
+        *p == 'e' || *p == 'E' || *p == 'x' || *p == 'X')
+        return slowParseDouble(str, value);
+
+    double result = (double)mantissa / exactPow10[decimals];
+    value = negative ? -result : result;
+    return p;
+}
+
+const char* parseInt( const char* str, int& value)
+{
+    const char* p = str;
+    while( isSpace(*p)) ++p;
+
+    bool negative = false;
+    if( *p == '-' || *p == '+') negative = (*p++ == '-');
+    if( !isDigit(*p)) return NULL;
+
+    long result = 0;
+    for( ; isDigit(*p); ++p) result = result * 10 + (*p - '0');
+
+    value = negative ? -result : result;
+    return p;
+}
+
+void parsePosition( const char* line,
+    double& x, double& y, double& orientation, int& qlen)
+{
+    const char* p = line;
+    if( (p = parseDouble(p, x)) && (p = parseDouble(p, y)) &&
+        (p = parseDouble(p, orientation))) parseInt(p, qlen);
+    orientation *= (M_PI / 180.0);
+}
+
+}
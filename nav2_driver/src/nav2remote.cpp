@@ -8,16 +8,147 @@
 #include <cstring>
 #include <cmath>
 #include <stdexcept>
+#include <cerrno>
+#include <ctime>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 
 #include <nav2_driver/nav2remote.h>
+#include <nav2_driver/nav2protocol.h>
+#include <nav2_driver/traffic_log.h>
 
-Nav2Remote::Nav2Remote( const char *host, int port)
-    : line(NULL), lineLen(0), fd(-1)
+namespace
 {
+
+using namespace nav2protocol;
+
+double parseValue( const char* line)
+{
+    double result;
+    parseDouble(line, result);
+    return result;
+}
+
+// connect() that gives up after timeout seconds, leaving fd blocking.
+int connectWithTimeout( int fd, const struct sockaddr* addr, socklen_t len,
+    double timeout)
+{
+    if( timeout <= 0) return connect(fd, addr, len);
+
+    int flags = fcntl(fd, F_GETFL);
+    if( flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return -1;
+
+    int rc = connect(fd, addr, len);
+    if( rc < 0 && errno == EINPROGRESS) {
+        struct pollfd p;
+        p.fd = fd;
+        p.events = POLLOUT;
+        p.revents = 0;
+        rc = -1;
+        if( poll(&p, 1, (int)(timeout * 1000)) == 1) {
+            int err = 0;
+            socklen_t errlen = sizeof(err);
+            if( getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen) == 0 && err == 0) rc = 0;
+        }
+    }
+
+    if( fcntl(fd, F_SETFL, flags) < 0) return -1;
+    return rc;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int setIntOption( int fd, int level, int name, int value)
+{
+    return setsockopt(fd, level, name, &value, sizeof(value));
+}
+
+int setTimeoutOption( int fd, int name, double timeout)
+{
+    struct timeval tv;
+    tv.tv_sec = (time_t)timeout;
+    tv.tv_usec = (suseconds_t)((timeout - tv.tv_sec) * 1e6);
+    return setsockopt(fd, SOL_SOCKET, name, &tv, sizeof(tv));
+}
+
+// Mark outgoing packets with a socket priority and IP type of service,
+// either of which may be -1 to leave it.
+int setMarking( int fd, int priority, int tos)
+{
+    int rc = 0;
+#ifdef SO_PRIORITY
+    if( priority >= 0)
+        rc |= setIntOption(fd, SOL_SOCKET, SO_PRIORITY, priority);
+#endif
+
+    if( tos >= 0) {
+        // Only one of these applies, depending on the address family.
+        int ip = setIntOption(fd, IPPROTO_IP, IP_TOS, tos);
+#ifdef IPV6_TCLASS
+        int ip6 = setIntOption(fd, IPPROTO_IPV6, IPV6_TCLASS, tos);
+        if( ip < 0 && ip6 < 0) rc = -1;
+#else
+        rc |= ip;
+#endif
+    }
+    return rc;
+}
+
+// Open a datagram socket to port on the peer of the connected socket fd.
+int connectDatagram( int fd, int port)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if( getpeername(fd, (struct sockaddr*)&addr, &len) < 0) return -1;
+    if( addr.ss_family == AF_INET) {
+        ((struct sockaddr_in*)&addr)->sin_port = htons(port);
+    } else if( addr.ss_family == AF_INET6) {
+        ((struct sockaddr_in6*)&addr)->sin6_port = htons(port);
+    } else {
+        return -1;
+    }
+
+    int udp = socket(addr.ss_family, SOCK_DGRAM, 0);
+    if( udp < 0) return -1;
+    if( connect(udp, (struct sockaddr*)&addr, len) < 0) {
+        close(udp);
+        return -1;
+    }
+    return udp;
+}
+
+}
+
+Nav2Remote::Nav2Remote( const char *host, int port, double timeout,
+    const SocketOptions& options)
+    : rxHead(0), rxTail(0), lineLen(0), fd(-1),
+      rxStampHead(0), rxStampTail(0), querySent(0), queryTime(0), replyTime(0),
+      txLen(0), batching(false), velocityFd(-1), velocitySeq(0),
+      trafficLog(NULL), trafficChannel(0),
+      streamGeneration(0), streaming(false), motionQueued(0), motionDone(0),
+      queryQueued(0), clearCount(0), queryCleared(0), queueLength(0), waitInterval(0.02), cachedX(0), cachedY(0),
+      cachedOrientation(0), cachedQueryTime(0), cachedReplyTime(0),
+      poseCached(false), cacheMaxAge(0)
+{
+    for( int i = 0; i < LIMITS; ++i) {
+        cachedLimits[i] = 0;
+        limitCached[i] = false;
+    }
+
     if(port < 1 || port > 65535) throw std::invalid_argument("Invalid port");
 
     char service[6];
@@ -39,190 +170,708 @@ Nav2Remote::Nav2Remote( const char *host, int port)
 
         fd = socket( rp->ai_family, rp->ai_socktype, rp->ai_protocol);
         if( fd == -1) continue;
-        if( connect(fd, rp->ai_addr, rp->ai_addrlen) == 0) break;
+        if( connectWithTimeout(fd, rp->ai_addr, rp->ai_addrlen, timeout) == 0) break;
         close(fd);
         fd = -1;
     }
 
     freeaddrinfo(ai);
+
+    if( setSocketOptions(options) < 0) {
+        close(fd);
+        throw std::runtime_error("Can't set socket options");
+    }
+
+    if( options.velocityPort < 0 || options.velocityPort > 65535) {
+        close(fd);
+        throw std::invalid_argument("Invalid velocity port");
+    }
+    if( options.velocityPort > 0) {
+        velocityFd = connectDatagram(fd, options.velocityPort);
+        if( velocityFd < 0 || setMarking(velocityFd, options.priority, options.tos) < 0) {
+            if( velocityFd >= 0) close(velocityFd);
+            close(fd);
+            throw std::runtime_error("Can't open velocity channel");
+        }
+    }
 }
 
 Nav2Remote::~Nav2Remote()
 {
-    if(line) free(line);
+    if( velocityFd >= 0) close(velocityFd);
     close(fd);
 }
 
-int Nav2Remote::readLine() const
+int Nav2Remote::setSocketOptions( const SocketOptions& options)
 {
-    for( int pos=0;; ++pos) {
-        if( lineLen <= pos+1) {
-            lineLen += 32;
-            line = (char*)realloc(line, lineLen);
-            if( !line) throw std::bad_alloc();
-        }
-        if( read(fd, &line[pos], 1) <= 0) return -1;
+    int rc = 0;
+
+    rc |= setIntOption(fd, IPPROTO_TCP, TCP_NODELAY, options.noDelay);
+    rc |= setIntOption(fd, SOL_SOCKET, SO_KEEPALIVE, options.keepAlive);
+    if( options.keepAlive) {
+#ifdef TCP_KEEPIDLE
+        if( options.keepAliveIdle > 0)
+            rc |= setIntOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, options.keepAliveIdle);
+        if( options.keepAliveInterval > 0)
+            rc |= setIntOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, options.keepAliveInterval);
+        if( options.keepAliveCount > 0)
+            rc |= setIntOption(fd, IPPROTO_TCP, TCP_KEEPCNT, options.keepAliveCount);
+#endif
+    }
 
-        if( line[pos] == '\r') {
-            --pos;  // Ignore carriage returns, just in case!
-            continue;
+    rc |= setTimeoutOption(fd, SO_RCVTIMEO, options.recvTimeout);
+    rc |= setTimeoutOption(fd, SO_SNDTIMEO, options.sendTimeout);
+
+#ifdef SO_TIMESTAMPNS
+    rc |= setIntOption(fd, SOL_SOCKET, SO_TIMESTAMPNS, options.timestamps);
+#endif
+    rc |= setMarking(fd, options.priority, options.tos);
+
+    return rc < 0 ? -1 : 0;
+}
+
+int Nav2Remote::fillBuffer( bool block) const
+{
+    // Read whatever the socket has ready into the free part of the ring,
+    // which may wrap around the end of the buffer.
+    unsigned int used = rxTail - rxHead;
+    unsigned int space = RX_BUFFER_SIZE - used;
+    unsigned int start = rxTail & (RX_BUFFER_SIZE - 1);
+    unsigned int first = RX_BUFFER_SIZE - start;
+    if( first > space) first = space;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &rxBuffer[start];
+    iov[0].iov_len = first;
+    iov[1].iov_base = &rxBuffer[0];
+    iov[1].iov_len = space - first;
+
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(struct timespec))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov[1].iov_len ? 2 : 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    ssize_t n = recvmsg(fd, &msg, block ? 0 : MSG_DONTWAIT);
+    if( n < 0 && !block && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if( n <= 0) return -1;
+
+    rxTail += n;
+
+    // Use the kernel receive timestamp if there is one.
+    double time = 0;
+#ifdef SCM_TIMESTAMPNS
+    for( struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if( c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            time = ts.tv_sec + ts.tv_nsec * 1e-9;
         }
+    }
+#endif
+    if( time == 0) time = now();
+
+    // If the stamp ring is full, the oldest chunk takes the next stamp.
+    if( rxStampTail - rxStampHead == RX_STAMPS) ++rxStampHead;
+    RxStamp& stamp = rxStamps[rxStampTail++ & (RX_STAMPS - 1)];
+    stamp.end = rxTail;
+    stamp.time = time;
+
+    return n;
+}
+
+/**
+ * Returns the line length, -1 on IO error, or -2 if not blocking and
+ * no complete line is buffered yet.
+ */
+int Nav2Remote::readLine( bool block) const
+{
+    for(;;) {
+        while( rxHead != rxTail) {
+            char c = rxBuffer[rxHead++ & (RX_BUFFER_SIZE - 1)];
+
+            // Ignore carriage returns, just in case!
+            if( c == '\r') continue;
 
-        if( line[pos] == '\n') {
-            line[pos] = 0;
+            if( c == '\n') {
+                // The line ended in the oldest chunk that ends after it.
+                while( rxStampTail - rxStampHead > 1 &&
+                    (int)(rxStamps[rxStampHead & (RX_STAMPS - 1)].end - rxHead) < 0) ++rxStampHead;
+                replyTime = rxStamps[rxStampHead & (RX_STAMPS - 1)].time;
 
-            // Ignore lines that begin with | or +.
-            if( line[0] == '|' || line[0] == '+') {
-                pos = -1;
-                continue;
+                int len = lineLen;
+                line[len] = 0;
+                lineLen = 0;
+                if( trafficLog) trafficLog->push(TrafficLog::RECEIVED, line, len, trafficChannel);
+
+                // Ignore lines that begin with | or +.
+                if( line[0] == '|' || line[0] == '+') continue;
+
+                return len;
             }
 
-            return pos;
+            // Overlong lines are truncated rather than grown.
+            if( lineLen < MAX_LINE_LENGTH - 1) line[lineLen++] = c;
+        }
+
+        int n = fillBuffer(block);
+        if( n < 0) {
+            lineLen = 0;
+            return -1;
         }
+        if( n == 0) return -2;
     }
 }
 
 int Nav2Remote::setTargetOrientation( double orientation)
 {
-    char msg[128];
-    int p = sprintf(msg, "o %lf\n", orientation);
-    return write(fd,msg,p) == p ? 0 : -1;
+    double args[] = { orientation };
+    return sendCommand<SetTargetOrientation>(args);
 }
 
 int Nav2Remote::setAbsoluteVelocity( double vx, double vy)
 {
-    char msg[128];
-    int p = sprintf(msg, "av %lf %lf\n", vx, vy);
-    return write(fd,msg,p) == p ? 0 : -1;
+    double args[] = { vx, vy };
+    if( sendVelocity<SetAbsoluteVelocity>(args) < 0) return -1;
+    clearQueue();
+    return 0;
 }
 
 int Nav2Remote::setRelativeVelocity( double vx, double vy, double turnRate)
 {
-    char msg[128];
-    int p = sprintf(msg, "v %lf %lf %lf\n", vx, vy, turnRate * (180.0 / M_PI));
-    return write(fd,msg,p) == p ? 0 : -1;
+    double args[] = { vx, vy, turnRate };
+    if( sendVelocity<SetRelativeVelocity>(args) < 0) return -1;
+    clearQueue();
+    return 0;
 }
 
 int Nav2Remote::estimatePosition(
     double& x, double& y, double& orientation) const
 {
-    if( write(fd, "q\n", 2) != 2) return -1;
+    if( !poseFresh()) {
+        if( sendQuery("q\n", 2) < 0) return -1;
 
-    // Read the result
-    if( readLine() < 0) return -1;
+        // Read the result
+        if( readReply() < 0) return -1;
 
-    int qlen;
-    sscanf(line, "%lf %lf %lf %d", &x, &y, &orientation, &qlen);
-    orientation *= (M_PI / 180.0);
+        double qx = 0, qy = 0, qorientation = 0;
+        int qlen = 0;
+        parsePosition(line, qx, qy, qorientation, qlen);
+        updatePosition(queryQueued, queryCleared, qx, qy, qorientation, qlen);
+    }
 
+    x = cachedX;
+    y = cachedY;
+    orientation = cachedOrientation;
+    queryTime = cachedQueryTime;
+    replyTime = cachedReplyTime;
     return 0;
 }
 
 int Nav2Remote::setPosition( double x, double y, double orientation)
 {
-    char msg[128];
-    int p = sprintf(msg, "p %lf %lf %lf\n", x, y, orientation * (180.0 / M_PI));
-    return write(fd,msg,p) == p ? 0 : -1;
+    double args[] = { x, y, orientation };
+    if( sendCommand<SetPosition>(args) < 0) return -1;
+    poseCached = false;
+    return 0;
 }
 
 int Nav2Remote::stop()
 {
-    return write(fd,"s\n",2) == 2 ? 0 : -1;
+    if( sendCommand<Stop>(NULL) < 0) return -1;
+
+    // Nothing orders the two channels, so a velocity datagram still in
+    // flight could restart the base after the stop.  A newer datagram
+    // makes the base drop it.
+    if( velocityFd >= 0) {
+        double args[] = { 0.0, 0.0, 0.0 };
+        if( sendVelocity<SetRelativeVelocity>(args) < 0) return -1;
+    }
+    clearQueue();
+    return 0;
 }
 
 int Nav2Remote::turnLeft( double angle)
 {
-    char msg[128];
-    int p = sprintf(msg, "lt %lf\n", angle * (180.0 / M_PI));
-    return write(fd,msg,p) == p ? 0 : -1;
+    double args[] = { angle };
+    return queueMotion<TurnLeft>(args);
+}
+
+int Nav2Remote::turnLeft( double angle, const CompletionHandler& done)
+{
+    if( turnLeft(angle) < 0) return -1;
+    whenIdle(done);
+    return 0;
 }
 
 int Nav2Remote::move( double dist, double direction)
 {
-    char msg[128];
-    int p = sprintf(msg, "mv %lf %lf\n", dist, direction * (180.0 / M_PI));
-    return write(fd,msg,p) == p ? 0 : -1;
+    double args[] = { dist, direction };
+    return queueMotion<Move>(args);
+}
+
+int Nav2Remote::move( double dist, double direction,
+    const CompletionHandler& done)
+{
+    if( move(dist, direction) < 0) return -1;
+    whenIdle(done);
+    return 0;
 }
 
 int Nav2Remote::setMaxSpeed( double maxSpeed)
 {
-    char msg[128];
-    int p = sprintf(msg, "sms %lf\n", maxSpeed);
-    return write(fd,msg,p) == p ? 0 : -1;
+    return setLimit<SetMaxSpeed>(MAX_SPEED, maxSpeed);
 }
 
 int Nav2Remote::setMaxAccel( double maxAccel)
 {
-    char msg[128];
-    int p = sprintf(msg, "sma %lf\n", maxAccel);
-    return write(fd,msg,p) == p ? 0 : -1;
+    return setLimit<SetMaxAccel>(MAX_ACCEL, maxAccel);
 }
 
 int Nav2Remote::setMaxCorneringError( double maxCorneringError)
 {
-    char msg[128];
-    int p = sprintf(msg, "smce %lf\n", maxCorneringError);
-    return write(fd,msg,p) == p ? 0 : -1;
+    return setLimit<SetMaxCorneringError>(MAX_CORNERING_ERROR, maxCorneringError);
 }
 
-double Nav2Remote::getMaxSpeed() const
+template <class C>
+int Nav2Remote::setLimit( int limit, double value)
 {
-    if( write(fd, "qms\n", 4) != 4) return -1;
-
-    // Read the result
-    if( readLine() < 0) return -1;
-
-    double result;
-    sscanf(line, "%lf", &result);
+    if( sendCommand<C>(&value) < 0) return -1;
+    cachedLimits[limit] = value;
+    limitCached[limit] = true;
+    return 0;
+}
 
-    return result;
+double Nav2Remote::getMaxSpeed() const
+{
+    return getLimit(MAX_SPEED, "qms\n", 4);
 }
 
 double Nav2Remote::getMaxAccel() const
 {
-    if( write(fd, "qma\n", 4) != 4) return -1;
-
-    // Read the result
-    if( readLine() < 0) return -1;
-
-    double result;
-    sscanf(line, "%lf", &result);
-
-    return result;
+    return getLimit(MAX_ACCEL, "qma\n", 4);
 }
 
 double Nav2Remote::getMaxCorneringError() const
 {
-    if( write(fd, "qmce\n", 5) != 5) return -1;
+    return getLimit(MAX_CORNERING_ERROR, "qmce\n", 5);
+}
 
-    // Read the result
-    if( readLine() < 0) return -1;
+double Nav2Remote::getLimit( int limit, const char* cmd, int len) const
+{
+    if( cacheMaxAge > 0 && limitCached[limit]) return cachedLimits[limit];
 
-    double result;
-    sscanf(line, "%lf", &result);
+    if( sendQuery(cmd, len) < 0) return -1;
 
-    return result;
+    // Read the result
+    if( readReply() < 0) return -1;
+
+    cachedLimits[limit] = parseValue(line);
+    limitCached[limit] = true;
+    return cachedLimits[limit];
 }
 
 int Nav2Remote::getQueueSize() const
 {
-    if( write(fd, "q\n", 2) != 2) return -1;
+    if( poseFresh()) return queueLength;
+    return queryQueueSize();
+}
+
+int Nav2Remote::queryQueueSize() const
+{
+    if( sendQuery("q\n", 2) < 0) return -1;
 
     // Read the result
-    if( readLine() < 0) return -1;
+    if( readReply() < 0) return -1;
 
-    double x;
-    int qlen;
-    sscanf(line, "%lf %lf %lf %d", &x, &x, &x, &qlen);
+    double x = 0, y = 0, orientation = 0;
+    int qlen = 0;
+    parsePosition(line, x, y, orientation, qlen);
+    updatePosition(queryQueued, queryCleared, x, y, orientation, qlen);
 
     return qlen;
 }
 
+bool Nav2Remote::poseFresh() const
+{
+    return cacheMaxAge > 0 && poseCached && now() - cachedReplyTime <= cacheMaxAge;
+}
+
+void Nav2Remote::updatePosition( unsigned long queued, unsigned long cleared,
+    double x, double y, double orientation, int qlen) const
+{
+    cachedX = x;
+    cachedY = y;
+    cachedOrientation = orientation;
+    cachedQueryTime = queryTime;
+    cachedReplyTime = replyTime;
+    poseCached = true;
+    updateQueue(queued, cleared, qlen);
+}
+
 int Nav2Remote::wait() const
 {
+    unsigned long target = motionQueued;
     while(1) {
-        int rc = getQueueSize();
+        if( streaming && !pending.empty()) {
+            // Stream replies keep coming without asking for them, but
+            // only those sent after the last command show it done.
+            // Stream queries re-issued while batching have to go out
+            // before their replies can come back.
+            if( txLen > 0 && sendBuffered(NULL, 0) < 0) return -1;
+            if( readLine() < 0 || dispatchReply() < 0) {
+                failPending();
+                return -1;
+            }
+            if( queueLength == 0 && motionDone >= target) return 0;
+            continue;
+        }
+
+        int rc = queryQueueSize();
         if( rc < 1) return rc;
-        usleep(100000);
+
+        double delay = querySent + waitInterval - now();
+        if( delay > 0) usleep((useconds_t)(delay * 1e6));
+    }
+}
+
+void Nav2Remote::whenIdle( const CompletionHandler& handler) const
+{
+    if( motionDone == motionQueued) {
+        if( handler) handler(0);
+        return;
+    }
+    Completion completion;
+    completion.id = motionQueued;
+    completion.handler = handler;
+    completions.push_back(completion);
+}
+
+template <class C>
+int Nav2Remote::queueMotion( const double* args)
+{
+    if( sendCommand<C>(args) < 0) return -1;
+    ++motionQueued;
+    ++queueLength;
+    return 0;
+}
+
+void Nav2Remote::updateQueue( unsigned long queued, unsigned long cleared,
+    int qlen) const
+{
+    // Replies to queries sent before a clear report commands that are
+    // long gone.
+    if( cleared != clearCount) return;
+    if( qlen < 0 || (unsigned long)qlen > queued) return;
+
+    // Commands queued since the query are not in the reply yet.
+    queueLength = qlen + (int)(motionQueued - queued);
+
+    unsigned long done = queued - qlen;
+    if( done > motionDone) {
+        motionDone = done;
+        completeMotions(done, 0);
+    }
+}
+
+void Nav2Remote::clearQueue() const
+{
+    ++clearCount;
+    queueLength = 0;
+    motionDone = motionQueued;
+    completeMotions(motionDone, 1);
+}
+
+void Nav2Remote::completeMotions( unsigned long done, int rc) const
+{
+    // Pop before calling, so the handler may queue further commands.
+    while( !completions.empty() && completions.front().id <= done) {
+        CompletionHandler handler = completions.front().handler;
+        completions.pop_front();
+        if( handler) handler(rc);
+    }
+}
+
+int Nav2Remote::writeCommand( const char* cmd, int len) const
+{
+    if( write(fd, cmd, len) != len) return -1;
+    if( trafficLog) trafficLog->push(TrafficLog::SENT, cmd, len, trafficChannel);
+    return 0;
+}
+
+int Nav2Remote::sendCommand( const char* cmd, int len) const
+{
+    if( !batching) return writeCommand(cmd, len);
+
+    if( txLen + len > TX_BUFFER_SIZE && sendBuffered(NULL, 0) < 0) return -1;
+    memcpy(txBuffer + txLen, cmd, len);
+    txLen += len;
+    return 0;
+}
+
+// Encode straight into the batch, or into the idle batch buffer when
+// the command goes out right away.
+template <class C>
+int Nav2Remote::sendCommand( const double* args) const
+{
+    if( batching && txLen + C::BUFFER_SIZE > TX_BUFFER_SIZE &&
+        sendBuffered(NULL, 0) < 0) return -1;
+
+    char* cmd = txBuffer + txLen;
+    int len = encode<C>(cmd, args);
+    if( len < 0) {
+        errno = ERANGE;
+        return -1;
+    }
+    if( !batching) return writeCommand(cmd, len);
+    txLen += len;
+    return 0;
+}
+
+// Without a datagram channel velocity commands are ordinary commands.
+// Datagrams are never batched, and may be dropped when the socket
+// buffer is full, like any other lost packet.
+template <class C>
+int Nav2Remote::sendVelocity( const double* args) const
+{
+    if( velocityFd < 0) return sendCommand<C>(args);
+
+    char datagram[C::BUFFER_SIZE + MAX_UNSIGNED_LENGTH + 1];
+    int len = encodeSequenced<C>(datagram, velocitySeq + 1, args);
+    if( len < 0) {
+        errno = ERANGE;
+        return -1;
     }
+    ++velocitySeq;
+    if( send(velocityFd, datagram, len, MSG_DONTWAIT | MSG_NOSIGNAL) != len) {
+        if( errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) return 0;
+        return -1;
+    }
+    if( trafficLog) trafficLog->push(TrafficLog::SENT, datagram, len, trafficChannel);
+    return 0;
+}
+
+int Nav2Remote::sendQuery( const char* cmd, int len) const
+{
+    querySent = now();
+    queryQueued = motionQueued;
+    queryCleared = clearCount;
+    if( !batching) return writeCommand(cmd, len);
+    return sendBuffered(cmd, len);
+}
+
+// Write the collected commands followed by cmd with one system call.
+int Nav2Remote::sendBuffered( const char* cmd, int len) const
+{
+    struct iovec iov[2];
+    int count = 0;
+    if( txLen > 0) {
+        iov[count].iov_base = txBuffer;
+        iov[count].iov_len = txLen;
+        ++count;
+    }
+    if( len > 0) {
+        iov[count].iov_base = const_cast<char*>(cmd);
+        iov[count].iov_len = len;
+        ++count;
+    }
+    if( count == 0) return 0;
+
+    // Batched queries count as sent now.
+    double sent = now();
+    for( std::deque<PendingReply>::reverse_iterator it = pending.rbegin();
+        it != pending.rend() && it->sent == 0; ++it) it->sent = sent;
+
+    ssize_t total = txLen + len;
+    int buffered = txLen;
+    txLen = 0;
+    if( writev(fd, iov, count) != total) {
+        // Some of the queries may never have been sent.
+        failPending();
+        return -1;
+    }
+    if( trafficLog) {
+        if( buffered > 0) trafficLog->push(TrafficLog::SENT, txBuffer, buffered, trafficChannel);
+        if( len > 0) trafficLog->push(TrafficLog::SENT, cmd, len, trafficChannel);
+    }
+    return 0;
+}
+
+int Nav2Remote::commitBatch()
+{
+    if( !batching) return 0;
+    batching = false;
+    return sendBuffered(NULL, 0);
+}
+
+int Nav2Remote::queueQuery(
+    const char* cmd, int len, const PendingReply& reply) const
+{
+    // Batched queries get their send time once the batch goes out.
+    double sent = batching ? 0 : now();
+    if( sendCommand(cmd, len) < 0) return -1;
+    pending.push_back(reply);
+    pending.back().sent = sent;
+    pending.back().queued = motionQueued;
+    pending.back().cleared = clearCount;
+    return 0;
+}
+
+int Nav2Remote::estimatePositionAsync( const PositionHandler& handler) const
+{
+    PendingReply reply;
+    reply.kind = PendingReply::POSITION;
+    reply.position = handler;
+    reply.stream = 0;
+    reply.limit = NO_LIMIT;
+    return queueQuery("q\n", 2, reply);
+}
+
+int Nav2Remote::startPositionStream( const PositionHandler& handler, int depth)
+{
+    // Queries of an earlier stream are answered but not re-issued.
+    streamHandler = handler;
+    ++streamGeneration;
+    streaming = true;
+    for( int i = 0; i < depth; ++i) {
+        if( queueStreamQuery() < 0) return -1;
+    }
+    return 0;
+}
+
+int Nav2Remote::queueStreamQuery() const
+{
+    PendingReply reply;
+    reply.kind = PendingReply::POSITION;
+    reply.position = streamHandler;
+    reply.stream = streamGeneration;
+    reply.limit = NO_LIMIT;
+    return queueQuery("q\n", 2, reply);
+}
+
+int Nav2Remote::getMaxSpeedAsync( const ValueHandler& handler) const
+{
+    PendingReply reply;
+    reply.kind = PendingReply::VALUE;
+    reply.value = handler;
+    reply.stream = 0;
+    reply.limit = MAX_SPEED;
+    return queueQuery("qms\n", 4, reply);
+}
+
+int Nav2Remote::getMaxAccelAsync( const ValueHandler& handler) const
+{
+    PendingReply reply;
+    reply.kind = PendingReply::VALUE;
+    reply.value = handler;
+    reply.stream = 0;
+    reply.limit = MAX_ACCEL;
+    return queueQuery("qma\n", 4, reply);
+}
+
+int Nav2Remote::getMaxCorneringErrorAsync( const ValueHandler& handler) const
+{
+    PendingReply reply;
+    reply.kind = PendingReply::VALUE;
+    reply.value = handler;
+    reply.stream = 0;
+    reply.limit = MAX_CORNERING_ERROR;
+    return queueQuery("qmce\n", 5, reply);
+}
+
+// Returns -1 if the next stream query could not be sent.
+int Nav2Remote::dispatchReply() const
+{
+    // Pop before calling, so the handler may issue further queries.
+    PendingReply reply = pending.front();
+    pending.pop_front();
+    queryTime = reply.sent;
+
+    if( reply.kind == PendingReply::POSITION) {
+        double x = 0, y = 0, orientation = 0;
+        int qlen = 0;
+        parsePosition(line, x, y, orientation, qlen);
+        updatePosition(reply.queued, reply.cleared, x, y, orientation, qlen);
+        if( reply.position) reply.position(0, x, y, orientation, qlen);
+    } else {
+        double value = parseValue(line);
+        if( reply.limit != NO_LIMIT) {
+            cachedLimits[reply.limit] = value;
+            limitCached[reply.limit] = true;
+        }
+        if( reply.value) reply.value(0, value);
+    }
+
+    if( streaming && reply.stream == streamGeneration) return queueStreamQuery();
+    return 0;
+}
+
+void Nav2Remote::failPending() const
+{
+    // The connection is gone, and so is any hope of seeing completions.
+    completeMotions(motionQueued, -1);
+
+    while( !pending.empty()) {
+        PendingReply reply = pending.front();
+        pending.pop_front();
+
+        if( reply.kind == PendingReply::POSITION) {
+            if( reply.position) reply.position(-1, 0.0, 0.0, 0.0, 0);
+        } else {
+            if( reply.value) reply.value(-1, 0.0);
+        }
+    }
+}
+
+int Nav2Remote::readReply() const
+{
+    // Replies to earlier asynchronous queries arrive first.
+    if( flush() < 0) return -1;
+    int rc = readLine();
+    queryTime = querySent;
+    return rc;
+}
+
+int Nav2Remote::processReplies() const
+{
+    // Read even with nothing pending, or a closed connection or a stray
+    // status line would leave the socket readable for good.
+    int count = 0;
+    for(;;) {
+        int rc = readLine(false);
+        if( rc == -2) break;
+        if( rc < 0) {
+            failPending();
+            return -1;
+        }
+        if( pending.empty()) continue;
+        if( dispatchReply() < 0) {
+            failPending();
+            return -1;
+        }
+        ++count;
+    }
+    return count;
+}
+
+int Nav2Remote::flush() const
+{
+    // Queries still collected in a batch have to go out first.
+    if( txLen > 0 && sendBuffered(NULL, 0) < 0) return -1;
+
+    // Queries issued by handlers meanwhile, stream queries included, are left in flight.
+    for( size_t count = pending.size(); count > 0; --count) {
+        if( readLine() < 0 || dispatchReply() < 0) {
+            failPending();
+            return -1;
+        }
+    }
+    return 0;
 }
@@ -0,0 +1,252 @@
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <nav2_driver/traffic_log.h>
+
+namespace
+{
+
+// Size of the part of the file mapped at a time, a multiple of the page size.
+const size_t MAP_CHUNK = 4 << 20;
+
+// Records are padded so that every header is aligned.
+inline size_t padded( size_t len)
+{
+    return (len + 7) & ~(size_t)7;
+}
+
+int64_t clockTime( clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+}
+
+const char TrafficLog::MAGIC[8] = { 'N', 'A', 'V', '2', 'L', 'O', 'G', '\n' };
+
+uint64_t TrafficLog::monotonicTime()
+{
+    return clockTime(CLOCK_MONOTONIC);
+}
+
+TrafficLog::TrafficLog( const std::string& path, size_t bufferSize,
+    bool mapped)
+    : ring(NULL), ringSize(256), head(0), tail(0), fd(-1), mapped(mapped),
+      map(NULL), mapOffset(0), mapUsed(0), dropped(0), written(0),
+      running(true)
+{
+    while( ringSize < bufferSize) ringSize <<= 1;
+
+    // Mapped writes need a file opened for reading as well.
+    fd = open(path.c_str(), (mapped ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0644);
+    if( fd < 0) throw std::runtime_error("Can't create traffic log");
+
+    FileHeader fileHeader;
+    memset(&fileHeader, 0, sizeof(fileHeader));
+    memcpy(fileHeader.magic, MAGIC, sizeof(MAGIC));
+    fileHeader.version = VERSION;
+    fileHeader.realtimeOffset = clockTime(CLOCK_REALTIME) - clockTime(CLOCK_MONOTONIC);
+    if( output((const char*)&fileHeader, sizeof(fileHeader)) < 0) {
+        if( map) munmap(map, MAP_CHUNK);
+        close(fd);
+        throw std::runtime_error("Can't write traffic log");
+    }
+
+    ring = new char[ringSize];
+    writer = boost::thread(&TrafficLog::writerLoop, this);
+}
+
+TrafficLog::~TrafficLog()
+{
+    running = false;
+    cond.notify_one();
+    writer.join();
+
+    // Cut the mapped file back to what was actually written.
+    if( map) {
+        munmap(map, MAP_CHUNK);
+        if( ftruncate(fd, mapOffset + mapUsed) < 0) {}
+    }
+    close(fd);
+    delete[] ring;
+}
+
+bool TrafficLog::push( int direction, const char* data, size_t len,
+    unsigned int channel)
+{
+    size_t total = sizeof(RecordHeader) + padded(len);
+    size_t start = tail.load(boost::memory_order_relaxed);
+    size_t used = start - head.load(boost::memory_order_acquire);
+    if( total > ringSize - used) {
+        ++dropped;
+        return false;
+    }
+
+    RecordHeader record;
+    record.time = monotonicTime();
+    record.length = len;
+    record.channel = channel;
+    record.direction = direction;
+    record.reserved = 0;
+
+    // Copy header, data and padding, each of which may wrap around the
+    // end of the ring.
+    struct { const char* data; size_t len; } parts[3] = {
+        { (const char*)&record, sizeof(record) }, { data, len }, { NULL, total - sizeof(record) - len }
+    };
+    size_t pos = start;
+    for( int i = 0; i < 3; ++i) {
+        size_t offset = pos & (ringSize - 1);
+        size_t first = ringSize - offset;
+        if( first > parts[i].len) first = parts[i].len;
+        if( parts[i].data) {
+            memcpy(ring + offset, parts[i].data, first);
+            memcpy(ring, parts[i].data + first, parts[i].len - first);
+        } else {
+            memset(ring + offset, 0, first);
+            memset(ring, 0, parts[i].len - first);
+        }
+        pos += parts[i].len;
+    }
+    tail.store(start + total, boost::memory_order_release);
+
+    // The writer polls anyway; only wake it early when the ring fills up.
+    if( used + total > ringSize / 2) cond.notify_one();
+    return true;
+}
+
+void TrafficLog::writerLoop()
+{
+    while( running) {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            cond.timed_wait(lock, boost::posix_time::milliseconds(10));
+        }
+        drain();
+    }
+    drain();
+}
+
+int TrafficLog::drain()
+{
+    size_t start = head.load(boost::memory_order_relaxed);
+    size_t end = tail.load(boost::memory_order_acquire);
+    if( start == end) return 0;
+
+    size_t offset = start & (ringSize - 1);
+    size_t len = end - start;
+    size_t first = ringSize - offset;
+    if( first > len) first = len;
+    int rc = output(ring + offset, first);
+    if( rc == 0 && len > first) rc = output(ring, len - first);
+
+    // On error the records are lost either way; keep the ring moving.
+    head.store(end, boost::memory_order_release);
+    return rc;
+}
+
+int TrafficLog::output( const char* data, size_t len)
+{
+    while( len > 0) {
+        ssize_t n;
+        if( mapped) {
+            if( (!map || mapUsed == MAP_CHUNK) && remap() < 0) return -1;
+            n = MAP_CHUNK - mapUsed;
+            if( (size_t)n > len) n = len;
+            memcpy(map + mapUsed, data, n);
+            mapUsed += n;
+        } else {
+            n = write(fd, data, len);
+            if( n < 0) {
+                if( errno == EINTR) continue;
+                return -1;
+            }
+        }
+        data += n;
+        len -= n;
+        written += n;
+    }
+    return 0;
+}
+
+// Move the mapped window to the end of the file, growing it by one chunk.
+int TrafficLog::remap()
+{
+    if( map) {
+        munmap(map, MAP_CHUNK);
+        map = NULL;
+        mapOffset += MAP_CHUNK;
+    }
+    mapUsed = 0;
+    if( ftruncate(fd, mapOffset + MAP_CHUNK) < 0) return -1;
+    void* p = mmap(NULL, MAP_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mapOffset);
+    if( p == MAP_FAILED) return -1;
+    map = (char*)p;
+    return 0;
+}
+
+TrafficLogReader::TrafficLogReader( const std::string& path)
+    : data(NULL), size(0), offset(sizeof(TrafficLog::FileHeader))
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if( fd < 0) throw std::runtime_error("Can't open traffic log");
+
+    struct stat st;
+    if( fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header)) {
+        close(fd);
+        throw std::runtime_error("Not a traffic log");
+    }
+    size = st.st_size;
+    void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if( p == MAP_FAILED) throw std::runtime_error("Can't map traffic log");
+    data = (const char*)p;
+
+    memcpy(&header, data, sizeof(header));
+    if( memcmp(header.magic, TrafficLog::MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TrafficLog::VERSION) {
+        munmap((void*)data, size);
+        throw std::runtime_error("Not a traffic log");
+    }
+}
+
+TrafficLogReader::~TrafficLogReader()
+{
+    munmap((void*)data, size);
+}
+
+bool TrafficLogReader::next( Record& record)
+{
+    TrafficLog::RecordHeader recordHeader;
+    if( size - offset < sizeof(recordHeader)) return false;
+    memcpy(&recordHeader, data + offset, sizeof(recordHeader));
+
+    // A zero time marks the unused tail of a mapped log that was not
+    // closed properly.
+    if( recordHeader.time == 0) return false;
+    if( size - offset - sizeof(recordHeader) < recordHeader.length) return false;
+
+    record.time = recordHeader.time;
+    record.channel = recordHeader.channel;
+    record.direction = recordHeader.direction;
+    record.data = data + offset + sizeof(recordHeader);
+    record.length = recordHeader.length;
+
+    offset += sizeof(recordHeader) + padded(recordHeader.length);
+    if( offset > size) offset = size;
+    return true;
+}
+
+void TrafficLogReader::rewind()
+{
+    offset = sizeof(TrafficLog::FileHeader);
+}
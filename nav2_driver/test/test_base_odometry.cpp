@@ -0,0 +1,131 @@
+/**
+ * Tests for integrating the poses reported by the base into odometry.
+ */
+
+#include <nav2_driver/base_odometry.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+using nav2_driver::BaseOdometry;
+using nav2_driver::Pose2D;
+
+TEST(Pose2D, ArithmeticLeavesOperandsUnchanged){
+
+    Pose2D a(3.0, 4.0, 0.5), b(1.0, 2.0, 0.25);
+    Pose2D difference = a - b;
+    Pose2D sum = a + b;
+    Pose2D half = a / 2.0;
+
+    EXPECT_DOUBLE_EQ(2.0, difference.x);
+    EXPECT_DOUBLE_EQ(2.0, difference.y);
+    EXPECT_DOUBLE_EQ(0.25, difference.th);
+    EXPECT_DOUBLE_EQ(4.0, sum.x);
+    EXPECT_DOUBLE_EQ(1.5, half.x);
+    EXPECT_DOUBLE_EQ(3.0, a.x);
+    EXPECT_DOUBLE_EQ(4.0, a.y);
+    EXPECT_DOUBLE_EQ(0.5, a.th);
+    EXPECT_DOUBLE_EQ(1.0, b.x);
+
+}
+
+TEST(BaseOdometry, AbsoluteSamplesIntegrateToThePoseReported){
+
+    BaseOdometry odom;
+    for(int i = 1; i <= 5; ++i){
+        odom.updateWithAbsolute(Pose2D(i, -0.5 * i, 0.1 * i), ros::Time(100.0 + i));
+        EXPECT_NEAR(i, odom.getPose().x, 1e-12);
+        EXPECT_NEAR(-0.5 * i, odom.getPose().y, 1e-12);
+        EXPECT_NEAR(0.1 * i, odom.getPose().th, 1e-12);
+    }
+    EXPECT_DOUBLE_EQ(105.0, odom.getStamp().toSec());
+
+}
+
+TEST(BaseOdometry, OffsetIsAddedToAbsoluteSamples){
+
+    //a reconnected base starts counting from zero again, the offset keeps the published pose continuous
+    BaseOdometry odom(Pose2D(10.0, 20.0, 1.0));
+    odom.updateWithAbsolute(Pose2D(1.0, 2.0, 0.5), ros::Time(1.0));
+    odom.updateWithAbsolute(Pose2D(1.5, 2.5, 0.75), ros::Time(2.0));
+
+    Pose2D pose = odom.getOffsetPose();
+    EXPECT_NEAR(11.5, pose.x, 1e-12);
+    EXPECT_NEAR(22.5, pose.y, 1e-12);
+    EXPECT_NEAR(1.75, pose.th, 1e-12);
+
+}
+
+TEST(BaseOdometry, OffsetPoseCarriesAcrossRepeatedReconnects){
+
+    //every connection starts counting from zero again, as the driver sees it after each reconnect
+    BaseOdometry odom;
+    for(int connection = 0; connection < 3; ++connection){
+        odom.updateWithAbsolute(Pose2D(1.0, 0.5, 0.25), ros::Time(connection + 1.0));
+        odom = BaseOdometry(odom.getOffsetPose());
+    }
+
+    Pose2D pose = odom.getOffsetPose();
+    EXPECT_NEAR(3.0, pose.x, 1e-12);
+    EXPECT_NEAR(1.5, pose.y, 1e-12);
+    EXPECT_NEAR(0.75, pose.th, 1e-12);
+
+}
+
+TEST(BaseOdometry, YawStaysContinuousAcrossTheRollover){
+
+    BaseOdometry odom;
+    odom.updateWithAbsolute(Pose2D(0.0, 0.0, 3.0), ros::Time(1.0));
+    odom.updateWithAbsolute(Pose2D(0.0, 0.0, -3.0), ros::Time(2.0));
+    EXPECT_NEAR(2.0 * M_PI - 3.0, odom.getPose().th, 1e-12);
+
+    odom.updateWithAbsolute(Pose2D(0.0, 0.0, 3.0), ros::Time(3.0));
+    EXPECT_NEAR(3.0, odom.getPose().th, 1e-12);
+
+}
+
+TEST(BaseOdometry, TwistFollowsAbsoluteSamples){
+
+    const nav2_driver::VelocityEstimator::Method methods[] = {
+        nav2_driver::VelocityEstimator::DIFFERENCE, nav2_driver::VelocityEstimator::LEAST_SQUARES
+    };
+    for(int m = 0; m < 2; ++m){
+        BaseOdometry odom(Pose2D(5.0, 5.0, 0.0), nav2_driver::VelocityEstimator(methods[m], 5));
+        for(int i = 1; i <= 20; ++i){
+            double t = 0.1 * i;
+            odom.updateWithAbsolute(Pose2D(0.4 * t, -0.1 * t, 0.2 * t), ros::Time(1000.0 + t));
+        }
+        Pose2D velocity = odom.getVelocity();
+        EXPECT_NEAR(0.4, velocity.x, 1e-6) << "method " << methods[m];
+        EXPECT_NEAR(-0.1, velocity.y, 1e-6) << "method " << methods[m];
+        EXPECT_NEAR(0.2, velocity.th, 1e-6) << "method " << methods[m];
+    }
+
+}
+
+TEST(BaseOdometry, BaseVelocityIsRotatedIntoTheBaseFrame){
+
+    //driving straight ahead along the odom y axis, heading a quarter turn left, half of it from an earlier connection
+    BaseOdometry odom(Pose2D(0.0, 0.0, M_PI / 4));
+    for(int i = 1; i <= 5; ++i){
+        double t = 0.1 * i;
+        odom.updateWithAbsolute(Pose2D(0.0, 0.3 * t, M_PI / 4), ros::Time(t));
+    }
+
+    Pose2D velocity = odom.getVelocity();
+    EXPECT_NEAR(0.0, velocity.x, 1e-9);
+    EXPECT_NEAR(0.3, velocity.y, 1e-9);
+
+    Pose2D base = odom.getBaseVelocity();
+    EXPECT_NEAR(0.3, base.x, 1e-9);
+    EXPECT_NEAR(0.0, base.y, 1e-9);
+    EXPECT_NEAR(0.0, base.th, 1e-9);
+
+}
+
+int main(int argc, char** argv){
+    ros::Time::init();
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
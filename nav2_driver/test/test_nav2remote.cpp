@@ -0,0 +1,299 @@
+/**
+ * Soak tests for Nav2Remote against the mock base: control cycles and pipelined queries through noise lines and
+ * dropped connections, reconnecting the way the driver does.
+ */
+
+#include "../benchmark/mock_nav2_server.h"
+
+#include <nav2_driver/nav2remote.h>
+
+#include <gtest/gtest.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace{
+
+using nav2_driver::MockNav2Server;
+
+struct PositionCount{
+
+    PositionCount() : ok(0), failed(0) {}
+
+    void handle(int rc, double x, double y, double th){
+        if(rc == 0){
+            ++ok;
+            EXPECT_TRUE(std::isfinite(x) && std::isfinite(y) && std::isfinite(th));
+        }else{
+            ++failed;
+        }
+    }
+
+    int ok, failed;
+
+};
+
+}
+
+TEST(Nav2Remote, ControlCyclesSurviveDropsAndNoise){
+
+    MockNav2Server::Options options;
+    options.drop_rate = 0.01;
+    options.noise_rate = 0.3;
+    MockNav2Server server(options);
+    server.start();
+
+    boost::shared_ptr<Nav2Remote> remote;
+    unsigned long connects = 0;
+    int cycles = 0, failures = 0;
+    double x, y, th;
+    for(int i = 0; i < 3000; ++i){
+        if(!remote){
+            remote.reset(new Nav2Remote("127.0.0.1", server.getPort()));
+            ++connects;
+        }
+        if(remote->setRelativeVelocity(0.1, 0.0, 0.2) < 0 || remote->estimatePosition(x, y, th) < 0){
+            //the driver drops the connection on any error and connects again
+            ++failures;
+            remote.reset();
+            continue;
+        }
+        ++cycles;
+        ASSERT_TRUE(std::isfinite(x) && std::isfinite(y) && std::isfinite(th));
+    }
+    remote.reset();
+    server.stop();
+
+    EXPECT_GT(failures, 0);
+    EXPECT_GT(cycles, 2000);
+    EXPECT_EQ(connects, server.getConnectionCount());
+
+}
+
+TEST(Nav2Remote, PipelinedQueriesAllCompleteThroughDrops){
+
+    MockNav2Server::Options options;
+    options.drop_rate = 0.002;
+    options.noise_rate = 0.1;
+    options.latency = 0.0005;
+    MockNav2Server server(options);
+    server.start();
+
+    const int queries = 5000;
+    const int window = 8;
+    PositionCount count;
+    boost::shared_ptr<Nav2Remote> remote;
+    int issued = 0, drops = 0;
+    while(issued < queries){
+        if(!remote){
+            remote.reset(new Nav2Remote("127.0.0.1", server.getPort()));
+        }
+
+        bool failed = false;
+        while(!failed && issued < queries && remote->getPendingReplies() < window){
+            if(remote->estimatePositionAsync(boost::bind(&PositionCount::handle, &count, _1, _2, _3, _4)) < 0){
+                failed = true;
+            }else{
+                ++issued;
+            }
+        }
+        if(!failed){
+            struct pollfd fd = { remote->getFd(), POLLIN, 0 };
+            poll(&fd, 1, 1000);
+            failed = remote->processReplies() < 0;
+        }
+        if(failed){
+            //fail whatever is still pending, as a dead connection has no replies left to read
+            remote->flush();
+            EXPECT_EQ(0, remote->getPendingReplies());
+            remote.reset();
+            ++drops;
+        }
+    }
+    if(remote){
+        EXPECT_EQ(0, remote->flush());
+    }
+    remote.reset();
+    server.stop();
+
+    //every query gets exactly one answer, a position or a failure
+    EXPECT_EQ(issued, count.ok + count.failed);
+    EXPECT_GT(drops, 0);
+    EXPECT_GT(count.ok, queries / 2);
+
+}
+
+TEST(Nav2Remote, NoiseLinesAreSkipped){
+
+    MockNav2Server::Options options;
+    options.noise_rate = 1.0;
+    MockNav2Server server(options);
+    server.start();
+
+    Nav2Remote remote("127.0.0.1", server.getPort());
+    ASSERT_EQ(0, remote.setPosition(1.5, -2.0, 90.0));
+    double x, y, th;
+    for(int i = 0; i < 100; ++i){
+        ASSERT_EQ(0, remote.estimatePosition(x, y, th));
+        EXPECT_NEAR(1.5, x, 1e-6);
+        EXPECT_NEAR(-2.0, y, 1e-6);
+    }
+    server.stop();
+
+}
+
+TEST(Nav2Remote, QueueLengthCountsCommandsQueuedSinceTheQuery){
+
+    MockNav2Server::Options options;
+    options.latency = 0.02;
+    options.segment_time = 60.0;
+    MockNav2Server server(options);
+    server.start();
+
+    Nav2Remote remote("127.0.0.1", server.getPort());
+    remote.setCacheMaxAge(60.0);
+
+    //the reply reports one command, the two sent while it was in flight still count
+    ASSERT_EQ(0, remote.forward(1.0));
+    ASSERT_EQ(0, remote.estimatePositionAsync(Nav2Remote::PositionHandler()));
+    ASSERT_EQ(0, remote.forward(1.0));
+    ASSERT_EQ(0, remote.forward(1.0));
+    ASSERT_EQ(0, remote.flush());
+    EXPECT_EQ(3, remote.getQueueSize());
+
+    //a reply to a query sent before a stop reports commands the stop removed
+    ASSERT_EQ(0, remote.estimatePositionAsync(Nav2Remote::PositionHandler()));
+    ASSERT_EQ(0, remote.stop());
+    ASSERT_EQ(0, remote.forward(1.0));
+    ASSERT_EQ(0, remote.flush());
+    EXPECT_EQ(1, remote.getQueueSize());
+    remote.setCacheMaxAge(0.0);
+    EXPECT_EQ(1, remote.getQueueSize());
+    server.stop();
+
+}
+
+TEST(Nav2Remote, UnrepresentableArgumentsAreNotSent){
+
+    MockNav2Server server((MockNav2Server::Options()));
+    server.start();
+
+    Nav2Remote remote("127.0.0.1", server.getPort());
+    ASSERT_EQ(0, remote.setPosition(1.0, 2.0, 0.0));
+    errno = 0;
+    EXPECT_EQ(-1, remote.setPosition(1e20, 2.0, 0.0));
+    EXPECT_EQ(ERANGE, errno);
+    EXPECT_EQ(-1, remote.setRelativeVelocity(0.0, NAN, 0.0));
+    EXPECT_EQ(-1, remote.forward(HUGE_VAL));
+    EXPECT_EQ(0, remote.getQueueSize());
+
+    //nothing went out, so the connection is still in sync
+    double x, y, th;
+    ASSERT_EQ(0, remote.estimatePosition(x, y, th));
+    EXPECT_NEAR(1.0, x, 1e-6);
+    EXPECT_NEAR(2.0, y, 1e-6);
+    server.stop();
+
+}
+
+TEST(Nav2Remote, StopOutranksEarlierVelocityDatagrams){
+
+    MockNav2Server::Options options;
+    options.udp_port = 0;
+    MockNav2Server server(options);
+    server.start();
+
+    Nav2Remote::SocketOptions socket;
+    socket.velocityPort = server.getUdpPort();
+    Nav2Remote remote("127.0.0.1", server.getPort(), 0.0, socket);
+    ASSERT_TRUE(remote.hasVelocityChannel());
+
+    ASSERT_EQ(0, remote.setRelativeVelocity(0.0, 0.5, 0.0));
+    unsigned int moving = remote.getVelocitySequence();
+    ASSERT_EQ(0, remote.stop());
+    EXPECT_EQ(moving + 1, remote.getVelocitySequence());
+
+    //the mock has seen the stop once it answers the query, give the datagrams a moment longer
+    double x, y, th;
+    ASSERT_EQ(0, remote.estimatePosition(x, y, th));
+    usleep(20000);
+    std::vector<MockNav2Server::CommandRecord> commands = server.takeVelocityCommands();
+    ASSERT_EQ(2u, commands.size());
+    EXPECT_EQ("v 0.000000 0.000000 0.000000", commands.back().line);
+    server.stop();
+
+}
+
+TEST(Nav2Remote, UnsolicitedDataIsDrainedAndEndOfFileReported){
+
+    //a bare listener, so that the test controls exactly what the base sends
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listener, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    ASSERT_EQ(0, bind(listener, (struct sockaddr*)&address, sizeof(address)));
+    ASSERT_EQ(0, listen(listener, 1));
+    ASSERT_EQ(0, getsockname(listener, (struct sockaddr*)&address, &length));
+
+    Nav2Remote remote("127.0.0.1", ntohs(address.sin_port));
+    int base = accept(listener, NULL, NULL);
+    ASSERT_GE(base, 0);
+    close(listener);
+
+    //status lines and stray replies arrive with no query in flight, and must not leave the socket readable
+    const char stray[] = "| status line\r\n0.000000 0.000000 0.000000 0\n";
+    ASSERT_EQ((ssize_t)sizeof(stray) - 1, write(base, stray, sizeof(stray) - 1));
+    struct pollfd fd = { remote.getFd(), POLLIN, 0 };
+    ASSERT_EQ(1, poll(&fd, 1, 1000));
+    EXPECT_EQ(0, remote.processReplies());
+    fd.revents = 0;
+    EXPECT_EQ(0, poll(&fd, 1, 0));
+
+    close(base);
+    ASSERT_EQ(1, poll(&fd, 1, 1000));
+    EXPECT_EQ(-1, remote.processReplies());
+
+}
+
+TEST(Nav2Remote, WaitingInsideABatchSendsTheCollectedQueries){
+
+    MockNav2Server server((MockNav2Server::Options()));
+    server.start();
+
+    //a query left in the batch is never answered, so do not wait for it long
+    Nav2Remote::SocketOptions socket;
+    socket.recvTimeout = 1.0;
+    Nav2Remote remote("127.0.0.1", server.getPort(), 0.0, socket);
+
+    PositionCount count;
+    remote.beginBatch();
+    ASSERT_EQ(0, remote.estimatePositionAsync(boost::bind(&PositionCount::handle, &count, _1, _2, _3, _4)));
+    EXPECT_EQ(0, remote.flush());
+    EXPECT_EQ(1, count.ok);
+
+    ASSERT_EQ(0, remote.startPositionStream(boost::bind(&PositionCount::handle, &count, _1, _2, _3, _4)));
+    EXPECT_EQ(0, remote.wait());
+    EXPECT_EQ(0, count.failed);
+    EXPECT_EQ(0, remote.commitBatch());
+    server.stop();
+
+}
+
+int main(int argc, char** argv){
+    //writes to a connection the mock just dropped must fail with EPIPE, as they do under roscpp
+    signal(SIGPIPE, SIG_IGN);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
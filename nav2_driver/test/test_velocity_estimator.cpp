@@ -0,0 +1,208 @@
+/**
+ * Tests for the velocity estimators against trajectories with a known velocity.
+ */
+
+#include <nav2_driver/velocity_estimator.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+
+using nav2_driver::VelocityEstimator;
+
+namespace{
+
+const double VELOCITY[VelocityEstimator::AXES] = { 0.5, -0.2, 0.3 };
+
+//start at a ros::Time like stamp, so the estimators have to keep their precision
+const double START = 1.4e9;
+
+/**
+ * @brief Feed samples of a constant velocity trajectory, with jittered sample times
+ * @return time of the last sample
+ */
+double drive(VelocityEstimator& estimator, int samples, double* velocity){
+    double time = START;
+    for(int k = 0; k < samples; ++k){
+        time += 0.05 + 0.01 * std::sin(1.7 * k);
+        double position[VelocityEstimator::AXES];
+        for(int i = 0; i < VelocityEstimator::AXES; ++i){
+            position[i] = 10.0 * i + VELOCITY[i] * (time - START);
+        }
+        estimator.update(time, position, velocity);
+    }
+    return time;
+}
+
+/**
+ * @brief Normally distributed noise, from a fixed seed so that the test is repeatable
+ */
+double gaussian(double sigma){
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sigma * std::sqrt(-2.0 * std::log(u)) * std::cos(2.0 * M_PI * v);
+}
+
+/**
+ * @brief Variance of the least squares slope through some samples, straight from its definition
+ */
+double slopeVariance(const std::deque<double>& t, const std::deque<double>& p){
+    size_t n = t.size();
+    double mean_t = 0, mean_p = 0;
+    for(size_t k = 0; k < n; ++k){
+        mean_t += t[k] / n;
+        mean_p += p[k] / n;
+    }
+    double stt = 0, stp = 0;
+    for(size_t k = 0; k < n; ++k){
+        stt += (t[k] - mean_t) * (t[k] - mean_t);
+        stp += (t[k] - mean_t) * (p[k] - mean_p);
+    }
+    double slope = stp / stt, rss = 0;
+    for(size_t k = 0; k < n; ++k){
+        double residual = p[k] - mean_p - slope * (t[k] - mean_t);
+        rss += residual * residual;
+    }
+    return rss / (n - 2) / stt;
+}
+
+}
+
+TEST(VelocityEstimator, LeastSquaresRecoversAConstantVelocity){
+
+    VelocityEstimator estimator(VelocityEstimator::LEAST_SQUARES, 5);
+    double velocity[VelocityEstimator::AXES];
+
+    //exact from the second sample on, and across the rebase at every full window
+    for(int samples = 2; samples <= 40; ++samples){
+        estimator.reset();
+        drive(estimator, samples, velocity);
+        for(int i = 0; i < VelocityEstimator::AXES; ++i){
+            EXPECT_NEAR(VELOCITY[i], velocity[i], 1e-6) << samples << " samples, axis " << i;
+        }
+    }
+
+}
+
+TEST(VelocityEstimator, AlphaBetaConvergesToAConstantVelocity){
+
+    VelocityEstimator estimator(VelocityEstimator::ALPHA_BETA, 5, 0.5, 0.1);
+    double velocity[VelocityEstimator::AXES];
+    drive(estimator, 400, velocity);
+    for(int i = 0; i < VelocityEstimator::AXES; ++i){
+        EXPECT_NEAR(VELOCITY[i], velocity[i], 1e-6) << "axis " << i;
+    }
+
+}
+
+TEST(VelocityEstimator, DifferenceMatchesTheLastTwoSamples){
+
+    VelocityEstimator estimator;
+    double velocity[VelocityEstimator::AXES];
+    drive(estimator, 10, velocity);
+    for(int i = 0; i < VelocityEstimator::AXES; ++i){
+        EXPECT_NEAR(VELOCITY[i], velocity[i], 1e-6) << "axis " << i;
+    }
+
+}
+
+TEST(VelocityEstimator, StaleSamplesLeaveTheEstimateUnchanged){
+
+    VelocityEstimator estimator(VelocityEstimator::LEAST_SQUARES, 5);
+    double velocity[VelocityEstimator::AXES];
+    double time = drive(estimator, 10, velocity);
+
+    const double position[VelocityEstimator::AXES] = { 1e3, 1e3, 1e3 };
+    double stale[VelocityEstimator::AXES];
+    estimator.update(time, position, stale);
+    estimator.update(time - 1.0, position, stale);
+    for(int i = 0; i < VelocityEstimator::AXES; ++i){
+        EXPECT_EQ(velocity[i], stale[i]);
+    }
+
+}
+
+TEST(VelocityEstimator, VarianceMatchesTheSlopeStandardError){
+
+    const int window = 5;
+    VelocityEstimator estimator(VelocityEstimator::LEAST_SQUARES, window);
+    double velocity[VelocityEstimator::AXES], variance[VelocityEstimator::AXES];
+    EXPECT_FALSE(estimator.getVariance(variance));
+
+    srand(7);
+    std::deque<double> times, positions[VelocityEstimator::AXES];
+    double time = START;
+    for(int k = 0; k < 100; ++k){
+        time += 0.05 + 0.01 * std::sin(1.7 * k);
+        double position[VelocityEstimator::AXES];
+        for(int i = 0; i < VelocityEstimator::AXES; ++i){
+            position[i] = 10.0 * i + VELOCITY[i] * (time - START) + gaussian(0.01 * (i + 1));
+        }
+        estimator.update(time, position, velocity);
+
+        times.push_back(time - START);
+        for(int i = 0; i < VelocityEstimator::AXES; ++i){
+            positions[i].push_back(position[i]);
+        }
+        if(times.size() > (size_t)window){
+            times.pop_front();
+            for(int i = 0; i < VelocityEstimator::AXES; ++i){
+                positions[i].pop_front();
+            }
+        }
+
+        ASSERT_EQ(times.size() > 2, estimator.getVariance(variance)) << k << " samples";
+        if(times.size() > 2){
+            for(int i = 0; i < VelocityEstimator::AXES; ++i){
+                double expected = slopeVariance(times, positions[i]);
+                EXPECT_NEAR(expected, variance[i], 1e-6 * expected) << k << " samples, axis " << i;
+            }
+        }
+    }
+
+}
+
+TEST(VelocityEstimator, VarianceTracksTheScatterOfTheEstimates){
+
+    //evenly spaced samples, so the slope variance is sigma^2 / sum((t - mean)^2) for every window
+    const int window = 5, samples = 20000;
+    const double dt = 0.05, sigma = 0.01;
+    const double expected = sigma * sigma / (dt * dt * 10.0);
+
+    VelocityEstimator estimator(VelocityEstimator::LEAST_SQUARES, window);
+    double velocity[VelocityEstimator::AXES], variance[VelocityEstimator::AXES];
+    double reported = 0, scatter = 0;
+    srand(11);
+    for(int k = 0; k < samples; ++k){
+        double time = START + k * dt;
+        double position[VelocityEstimator::AXES] = { VELOCITY[0] * k * dt + gaussian(sigma), 0.0, 0.0 };
+        estimator.update(time, position, velocity);
+        if(k >= window){
+            ASSERT_TRUE(estimator.getVariance(variance));
+            reported += variance[0];
+            scatter += (velocity[0] - VELOCITY[0]) * (velocity[0] - VELOCITY[0]);
+        }
+    }
+    reported /= samples - window;
+    scatter /= samples - window;
+    EXPECT_NEAR(expected, reported, 0.05 * expected);
+    EXPECT_NEAR(expected, scatter, 0.1 * expected);
+
+}
+
+TEST(VelocityEstimator, OnlyLeastSquaresMeasuresVariance){
+
+    VelocityEstimator difference, alpha_beta(VelocityEstimator::ALPHA_BETA);
+    double velocity[VelocityEstimator::AXES], variance[VelocityEstimator::AXES];
+    drive(difference, 10, velocity);
+    drive(alpha_beta, 10, velocity);
+    EXPECT_FALSE(difference.getVariance(variance));
+    EXPECT_FALSE(alpha_beta.getVariance(variance));
+
+}
+
+int main(int argc, char** argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}